@@ -0,0 +1,58 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "buffer_pool_zenfs.h"
+
+#include <stdlib.h>
+
+namespace ROCKSDB_NAMESPACE {
+
+AlignedBufferPool::AlignedBufferPool(size_t alignment, size_t buf_sz,
+                                     size_t max_pooled)
+    : alignment_(alignment), buf_sz_(buf_sz), max_pooled_(max_pooled) {
+  allocations_.store(0);
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+  for (auto buf : free_) free(buf);
+}
+
+char *AlignedBufferPool::Get(size_t size) {
+  char *buf = nullptr;
+
+  if (size <= buf_sz_) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!free_.empty()) {
+      buf = free_.back();
+      free_.pop_back();
+      return buf;
+    }
+  }
+
+  size_t alloc_sz = (size <= buf_sz_) ? buf_sz_ : size;
+  if (alloc_sz % alignment_) alloc_sz += alignment_ - (alloc_sz % alignment_);
+  if (posix_memalign((void **)&buf, alignment_, alloc_sz)) return nullptr;
+  allocations_++;
+  return buf;
+}
+
+void AlignedBufferPool::Put(char *buf, size_t size) {
+  if (!buf) return;
+  if (size <= buf_sz_) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (free_.size() < max_pooled_) {
+      free_.push_back(buf);
+      return;
+    }
+  }
+  free(buf);
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,46 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace ROCKSDB_NAMESPACE {
+
+/* Pool of block aligned buffers for direct I/O.
+ *
+ * Buffers up to buf_sz come from a free list and go back to it, so hot read
+ * paths don't posix_memalign per request. Larger requests get a one-off
+ * aligned allocation that is freed on return.
+ */
+class AlignedBufferPool {
+ public:
+  AlignedBufferPool(size_t alignment, size_t buf_sz, size_t max_pooled);
+  ~AlignedBufferPool();
+
+  char *Get(size_t size);
+  void Put(char *buf, size_t size);
+
+  size_t GetBufferSize() { return buf_sz_; }
+  uint64_t GetAllocations() { return allocations_.load(); }
+
+ private:
+  size_t alignment_;
+  size_t buf_sz_;
+  size_t max_pooled_;
+
+  std::mutex mtx_;
+  std::vector<char *> free_;
+  std::atomic<uint64_t> allocations_;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -15,12 +15,14 @@
 
 #include <algorithm>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstdio>
 #include <map>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -82,7 +84,9 @@
 #include "rocksdb/convenience.h"
 #include "rocksdb/db.h"
 #include "rocksdb/env.h"
+#include "rocksdb/listener.h"
 #include "rocksdb/merge_operator.h"
+#include "rocksdb/rate_limiter.h"
 #include "rocksdb/statistics.h"
 #include "rocksdb/stats_history.h"
 #include "rocksdb/status.h"
@@ -112,6 +116,7 @@ namespace ROCKSDB_NAMESPACE {
 const std::string kDefaultColumnFamilyName("default");
 const std::string kPersistentStatsColumnFamilyName(
     "___rocksdb_stats_history___");
+const std::string kZenFSPropertyPrefix("rocksdb.zenfs.");
 void DumpRocksDBBuildVersion(Logger* log);
 
 CompressionType GetCompressionFlush(
@@ -148,13 +153,76 @@ void DumpSupportInfo(Logger* logger) {
   ROCKS_LOG_HEADER(logger, "Fast CRC32 supported: %s",
                    crc32c::IsFastCrc32Supported().c_str());
 }
+
+DBOptions WithListener(DBOptions options,
+                       std::shared_ptr<EventListener> listener) {
+  if (listener) {
+    options.listeners.push_back(std::move(listener));
+  }
+  return options;
+}
 }  // namespace
 
+#ifndef ROCKSDB_LITE
+// Table file events of one DBImpl for the ZenFS lifecycle trace. The
+// listener can outlive the DB through copies of its options, so the DB
+// detaches it when it closes.
+class ZenFSTraceListener : public EventListener {
+ public:
+  explicit ZenFSTraceListener(DBImpl* db) : db_(db) {}
+
+  void OnFlushCompleted(DB* /*db*/, const FlushJobInfo& info) override {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (db_ != nullptr) {
+      db_->TraceZenFSTables({info.file_number});
+    }
+  }
+
+  void OnCompactionCompleted(DB* /*db*/,
+                             const CompactionJobInfo& info) override {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (db_ != nullptr && info.status.ok()) {
+      db_->TraceZenFSCompaction(info);
+    }
+  }
+
+  void OnTableFileDeleted(const TableFileDeletionInfo& info) override {
+    uint64_t number;
+    FileType type;
+    size_t slash = info.file_path.find_last_of('/');
+    std::string fname = slash == std::string::npos
+                            ? info.file_path
+                            : info.file_path.substr(slash + 1);
+    if (!info.status.ok() || !ParseFileName(fname, &number, &type) ||
+        type != kTableFile) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (db_ != nullptr) {
+      db_->TraceZenFSTableDeleted(number);
+    }
+  }
+
+  void Detach() {
+    std::lock_guard<std::mutex> lock(mu_);
+    db_ = nullptr;
+  }
+
+ private:
+  std::mutex mu_;
+  DBImpl* db_;
+};
+#endif  // ROCKSDB_LITE
+
 DBImpl::DBImpl(const DBOptions& options, const std::string& dbname,
                const bool seq_per_batch, const bool batch_per_txn)
     : dbname_(dbname),
       own_info_log_(options.info_log == nullptr),
-      initial_db_options_(SanitizeOptions(dbname, options)),
+#ifndef ROCKSDB_LITE
+      zenfs_trace_listener_(std::make_shared<ZenFSTraceListener>(this)),
+#endif  // ROCKSDB_LITE
+      initial_db_options_(WithListener(SanitizeOptions(dbname, options),
+                                       zenfs_trace_listener_)),
       env_(initial_db_options_.env),
       io_tracer_(std::make_shared<IOTracer>()),
       immutable_db_options_(initial_db_options_),
@@ -194,6 +262,7 @@ DBImpl::DBImpl(const DBOptions& options, const std::string& dbname,
       bg_flush_scheduled_(0),
       num_running_flushes_(0),
       bg_purge_scheduled_(0),
+      bg_size_summary_scheduled_(0),
       disable_delete_obsolete_files_(0),
       pending_purge_obsolete_files_(0),
       delete_obsolete_files_last_run_(env_->NowMicros()),
@@ -308,6 +377,83 @@ int DBImpl::Getlevel() {
       versions_->GetColumnFamilySet()->GetDefault()->current()->storage_info();
   return vstorage->num_levels();
 }
+void DBImpl::GetZenFSWritePressure(bool* stopped, bool* delayed,
+                                   uint64_t* delayed_write_rate,
+                                   uint64_t* pending_compaction_bytes) {
+  *stopped = write_controller_.IsStopped();
+  *delayed = write_controller_.NeedsDelay();
+  *delayed_write_rate = write_controller_.delayed_write_rate();
+  // current() may only be read under mutex_, the SuperVersion keeps its
+  // Version alive without it.
+  auto cfd = versions_->GetColumnFamilySet()->GetDefault();
+  SuperVersion* sv = GetAndRefSuperVersion(cfd);
+  *pending_compaction_bytes =
+      sv->current->storage_info()->estimated_compaction_needed_bytes();
+  ReturnAndCleanupSuperVersion(cfd, sv);
+}
+Status DBImpl::GetZoneReclaimCandidates(
+    ColumnFamilyHandle* column_family, int level,
+    std::vector<ZoneReclaimCandidate>* out) {
+  out->clear();
+  auto hooks = GetZenFSHooks();
+  auto cfd = static_cast_with_check<ColumnFamilyHandleImpl>(column_family)
+                 ->cfd();
+  if (level < 0 || level >= cfd->NumberLevels()) {
+    return Status::InvalidArgument("Level out of range");
+  }
+  if (!hooks->zone_reclaim_benefit) {
+    return Status::OK();
+  }
+
+  // being_compacted is only stable under mutex_, the walk does no I/O.
+  mutex_.Lock();
+  VersionStorageInfo* vstorage = cfd->current()->storage_info();
+  for (const auto f : vstorage->LevelFiles(level)) {
+    if (f->being_compacted) continue;
+    ZoneReclaimCandidate c;
+    c.file_number = f->fd.GetNumber();
+    c.inputs.push_back(c.file_number);
+    c.input_bytes = f->fd.GetFileSize();
+    bool busy = false;
+    if (level + 1 < vstorage->num_levels()) {
+      std::vector<FileMetaData*> overlap;
+      vstorage->GetOverlappingInputs(level + 1, &f->smallest, &f->largest,
+                                     &overlap);
+      for (const auto o : overlap) {
+        if (o->being_compacted) {
+          busy = true;
+          break;
+        }
+        c.inputs.push_back(o->fd.GetNumber());
+        c.input_bytes += o->fd.GetFileSize();
+      }
+    }
+    if (busy) continue;
+    out->push_back(std::move(c));
+  }
+  mutex_.Unlock();
+
+  // The device is asked outside mutex_, it only needs numbers. The whole
+  // level goes in one call, so every zone is looked at once.
+  std::vector<std::vector<uint64_t>> file_sets;
+  std::vector<uint64_t> zones_freed;
+  for (const auto& c : *out) {
+    file_sets.push_back(c.inputs);
+  }
+  hooks->zone_reclaim_benefit(file_sets, &zones_freed);
+  for (size_t i = 0; i < out->size() && i < zones_freed.size(); i++) {
+    (*out)[i].zones_freed = zones_freed[i];
+  }
+  std::stable_sort(out->begin(), out->end(),
+                   [](const ZoneReclaimCandidate& a,
+                      const ZoneReclaimCandidate& b) {
+                     if (a.zones_freed != b.zones_freed) {
+                       return a.zones_freed > b.zones_freed;
+                     }
+                     return a.input_bytes < b.input_bytes;
+                   });
+  return Status::OK();
+}
 void DBImpl::AdjacentFileList(const InternalKey& s, const InternalKey& l, const int level, std::vector<uint64_t>& fno_list){
 
   auto vstorage = versions_->GetColumnFamilySet()->GetDefault()->current()->storage_info();
@@ -580,6 +726,9 @@ void DBImpl::CancelAllBackgroundWork(bool wait) {
 Status DBImpl::CloseHelper() {
   // Guarantee that there is no background error recovery in progress before
   // continuing with the shutdown
+#ifndef ROCKSDB_LITE
+  zenfs_trace_listener_->Detach();
+#endif  // ROCKSDB_LITE
   mutex_.Lock();
   shutdown_initiated_ = true;
   error_handler_.CancelErrorRecovery();
@@ -592,6 +741,7 @@ Status DBImpl::CloseHelper() {
   // marker. After this we do a variant of the waiting and unschedule work
   // (to consider: moving all the waiting into CancelAllBackgroundWork(true))
   CancelAllBackgroundWork(false);
+  multiget_lane_pool_.JoinAllThreads();
   int bottom_compactions_unscheduled =
       env_->UnSchedule(this, Env::Priority::BOTTOM);
   int compactions_unscheduled = env_->UnSchedule(this, Env::Priority::LOW);
@@ -605,7 +755,7 @@ Status DBImpl::CloseHelper() {
   // Wait for background work to finish
   while (bg_bottom_compaction_scheduled_ || bg_compaction_scheduled_ ||
          bg_flush_scheduled_ || bg_purge_scheduled_ ||
-         pending_purge_obsolete_files_ ||
+         bg_size_summary_scheduled_ || pending_purge_obsolete_files_ ||
          error_handler_.IsRecoveryInProgress()) {
     TEST_SYNC_POINT("DBImpl::~DBImpl:WaitJob");
     bg_cv_.Wait();
@@ -833,6 +983,10 @@ void DBImpl::PersistStats() {
   if (!statistics->getTickerMap(&stats_map)) {
     return;
   }
+  auto hooks = GetZenFSHooks();
+  if (hooks->get_stats_map) {
+    hooks->get_stats_map(&stats_map);
+  }
   ROCKS_LOG_INFO(immutable_db_options_.info_log,
                  "------- PERSISTING STATS -------");
 
@@ -991,6 +1145,14 @@ void DBImpl::DumpStats() {
   ROCKS_LOG_INFO(immutable_db_options_.info_log,
                  "------- DUMPING STATS -------");
   ROCKS_LOG_INFO(immutable_db_options_.info_log, "%s", stats.c_str());
+  auto hooks = GetZenFSHooks();
+  if (hooks->dump_stats) {
+    stats.clear();
+    hooks->dump_stats(&stats);
+    ROCKS_LOG_INFO(immutable_db_options_.info_log,
+                   "------- ZenFS STATS -------");
+    ROCKS_LOG_INFO(immutable_db_options_.info_log, "%s", stats.c_str());
+  }
   if (immutable_db_options_.dump_malloc_stats) {
     stats.clear();
     DumpMallocStats(&stats);
@@ -1011,6 +1173,89 @@ void DBImpl::FlushInfoLog() {
   }
   TEST_SYNC_POINT("DBImpl::FlushInfoLog:StartRunning");
   LogFlush(immutable_db_options_.info_log);
+  // The periodic work scheduler has no slot for ZenFS, its info log tick
+  // is frequent enough for zone draining.
+  MaybeDrainZones();
+}
+
+void DBImpl::MaybeDrainZones() {
+  auto hooks = GetZenFSHooks();
+  std::unordered_set<uint64_t> pinning;
+  if (hooks->pinning_files) {
+    std::vector<uint64_t> file_numbers;
+    hooks->pinning_files(&file_numbers);
+    pinning.insert(file_numbers.begin(), file_numbers.end());
+  }
+  // With co-scheduling on, the compaction of the default column family
+  // freeing the most zones outright is asked for as well, the picker adds
+  // its next level inputs.
+  ZoneReclaimCandidate best;
+  int num_levels = 0;
+  if (hooks->co_schedule && hooks->co_schedule()) {
+    num_levels = versions_->GetColumnFamilySet()->GetDefault()->NumberLevels();
+  }
+  for (int level = 0; level + 1 < num_levels; level++) {
+    std::vector<ZoneReclaimCandidate> candidates;
+    Status s =
+        GetZoneReclaimCandidates(DefaultColumnFamily(), level, &candidates);
+    if (!s.ok() || candidates.empty()) {
+      continue;
+    }
+    if (candidates[0].zones_freed > best.zones_freed) {
+      best = candidates[0];
+    }
+  }
+  if (best.zones_freed > 0) {
+    pinning.insert(best.file_number);
+  }
+  if (pinning.empty()) {
+    return;
+  }
+
+  // Marked files are picked up by the compaction picker the same way as
+  // files a table properties collector asked to have compacted.
+  std::vector<uint64_t> marked;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    if (shutdown_initiated_) {
+      return;
+    }
+    for (auto cfd : *versions_->GetColumnFamilySet()) {
+      if (cfd->IsDropped() || !cfd->initialized()) {
+        continue;
+      }
+      VersionStorageInfo* vstorage = cfd->current()->storage_info();
+      size_t cf_marked = 0;
+      for (int level = 0; level < vstorage->num_levels(); level++) {
+        for (auto f : vstorage->LevelFiles(level)) {
+          if (f->being_compacted || f->marked_for_compaction ||
+              !pinning.count(f->fd.GetNumber())) {
+            continue;
+          }
+          f->marked_for_compaction = true;
+          marked.push_back(f->fd.GetNumber());
+          cf_marked++;
+        }
+      }
+      if (cf_marked > 0) {
+        vstorage->ComputeFilesMarkedForCompaction();
+        SchedulePendingCompaction(cfd);
+      }
+    }
+    if (marked.empty()) {
+      return;
+    }
+    MaybeScheduleFlushOrCompaction();
+  }
+  ROCKS_LOG_INFO(immutable_db_options_.info_log,
+                 "ZenFS zone drain: %" ROCKSDB_PRIszt
+                 " of %" ROCKSDB_PRIszt " pinning files marked\n",
+                 marked.size(), pinning.size());
+  // Files still marked from an earlier tick are not counted again. The
+  // device takes its own locks, so it is told without mutex_.
+  if (hooks->drain_marked) {
+    hooks->drain_marked(marked);
+  }
 }
 
 Status DBImpl::TablesRangeTombstoneSummary(ColumnFamilyHandle* column_family,
@@ -1047,23 +1292,112 @@ FSDirectory* DBImpl::GetDataDir(ColumnFamilyData* cfd, size_t path_id) const {
   return ret_dir;
 }
 
+// DB side knob handled with the ZenFS keys, not a RocksDB option
+static const std::string kMultiGetLanesOption = "multiget_lanes";
+
+static bool ParseMultiGetLanes(const std::string& value, int* n) {
+  *n = 0;
+  try {
+    *n = ParseInt(value);
+  } catch (const std::exception&) {
+  }
+  return *n >= 1 && *n <= static_cast<int>(MultiGetContext::MAX_BATCH_SIZE);
+}
+
+Status DBImpl::CheckZenFSOptions(
+    const std::unordered_map<std::string, std::string>& input,
+    std::unordered_map<std::string, std::string>* zenfs_options,
+    std::unordered_map<std::string, std::string>* options_map) {
+  std::unordered_map<std::string, std::string> device_options;
+  for (const auto& o : input) {
+    if (o.first == kMultiGetLanesOption) {
+      zenfs_options->insert(o);
+    } else if (o.first.compare(0, 6, "zenfs_") == 0) {
+      zenfs_options->insert(o);
+      device_options.insert(o);
+    } else {
+      options_map->insert(o);
+    }
+  }
+  auto lanes = zenfs_options->find(kMultiGetLanesOption);
+  int n;
+  if (lanes != zenfs_options->end() && !ParseMultiGetLanes(lanes->second, &n)) {
+    return Status::InvalidArgument("Bad value for " + kMultiGetLanesOption,
+                                   lanes->second);
+  }
+  if (device_options.empty()) {
+    return Status::OK();
+  }
+  auto hooks = GetZenFSHooks();
+  if (!hooks->check_options) {
+    return Status::InvalidArgument("No ZenFS device attached");
+  }
+  return hooks->check_options(device_options);
+}
+
+Status DBImpl::ApplyZenFSOptions(
+    const std::unordered_map<std::string, std::string>& zenfs_options) {
+  std::unordered_map<std::string, std::string> device_options;
+  for (const auto& o : zenfs_options) {
+    int n;
+    if (o.first != kMultiGetLanesOption) {
+      device_options.insert(o);
+    } else if (ParseMultiGetLanes(o.second, &n)) {
+      // Never shrink the pool to nothing under a batch that still loaded
+      // the old lane count
+      multiget_lane_pool_.SetBackgroundThreads(std::max(n - 1, 1));
+      multiget_lanes_.store(n);
+      ROCKS_LOG_INFO(immutable_db_options_.info_log,
+                     "Option %s: %d applied\n", kMultiGetLanesOption.c_str(),
+                     n);
+    }
+  }
+  if (device_options.empty()) {
+    return Status::OK();
+  }
+  auto hooks = GetZenFSHooks();
+  if (!hooks->set_options) {
+    return Status::InvalidArgument("No ZenFS device attached");
+  }
+  Status s = hooks->set_options(device_options);
+  for (const auto& o : device_options) {
+    ROCKS_LOG_INFO(immutable_db_options_.info_log, "ZenFS option %s: %s %s\n",
+                   o.first.c_str(), o.second.c_str(),
+                   s.ok() ? "applied" : "rejected");
+  }
+  return s;
+}
+
 Status DBImpl::SetOptions(
     ColumnFamilyHandle* column_family,
-    const std::unordered_map<std::string, std::string>& options_map) {
+    const std::unordered_map<std::string, std::string>& input) {
 #ifdef ROCKSDB_LITE
   (void)column_family;
-  (void)options_map;
+  (void)input;
   return Status::NotSupported("Not supported in ROCKSDB LITE");
 #else
   auto* cfd =
       static_cast_with_check<ColumnFamilyHandleImpl>(column_family)->cfd();
-  if (options_map.empty()) {
+  if (input.empty()) {
     ROCKS_LOG_WARN(immutable_db_options_.info_log,
                    "SetOptions() on column family [%s], empty input",
                    cfd->GetName().c_str());
     return Status::InvalidArgument("empty input");
   }
 
+  // ZenFS keys are not column family options. They are only applied once
+  // the column family options went through, so a bad key anywhere leaves
+  // everything unchanged.
+  std::unordered_map<std::string, std::string> zenfs_options;
+  std::unordered_map<std::string, std::string> options_map;
+  Status zenfs_status = CheckZenFSOptions(input, &zenfs_options, &options_map);
+  if (!zenfs_status.ok()) {
+    return zenfs_status;
+  }
+  if (options_map.empty()) {
+    return ApplyZenFSOptions(zenfs_options);
+  }
+
   MutableCFOptions new_options;
   Status s;
   Status persist_options_status;
@@ -1090,6 +1424,9 @@ Status DBImpl::SetOptions(
     }
   }
   sv_context.Clean();
+  if (s.ok()) {
+    s = ApplyZenFSOptions(zenfs_options);
+  }
 
   ROCKS_LOG_INFO(
       immutable_db_options_.info_log,
@@ -1115,17 +1452,27 @@ Status DBImpl::SetOptions(
 }
 
 Status DBImpl::SetDBOptions(
-    const std::unordered_map<std::string, std::string>& options_map) {
+    const std::unordered_map<std::string, std::string>& input) {
 #ifdef ROCKSDB_LITE
-  (void)options_map;
+  (void)input;
   return Status::NotSupported("Not supported in ROCKSDB LITE");
 #else
-  if (options_map.empty()) {
+  if (input.empty()) {
     ROCKS_LOG_WARN(immutable_db_options_.info_log,
                    "SetDBOptions(), empty input.");
     return Status::InvalidArgument("empty input");
   }
 
+  std::unordered_map<std::string, std::string> zenfs_options;
+  std::unordered_map<std::string, std::string> options_map;
+  Status zenfs_status = CheckZenFSOptions(input, &zenfs_options, &options_map);
+  if (!zenfs_status.ok()) {
+    return zenfs_status;
+  }
+  if (options_map.empty()) {
+    return ApplyZenFSOptions(zenfs_options);
+  }
+
   MutableDBOptions new_options;
   Status s;
   Status persist_options_status = Status::OK();
@@ -1232,6 +1579,9 @@ Status DBImpl::SetDBOptions(
       persist_options_status.PermitUncheckedError();
     }
   }
+  if (s.ok()) {
+    s = ApplyZenFSOptions(zenfs_options);
+  }
   ROCKS_LOG_INFO(immutable_db_options_.info_log, "SetDBOptions(), inputs:");
   for (const auto& o : options_map) {
     ROCKS_LOG_INFO(immutable_db_options_.info_log, "%s: %s\n", o.first.c_str(),
@@ -1490,23 +1840,28 @@ void DBImpl::BackgroundCallPurge() {
     mutex_.Lock();
   }
 
-  // Can't use iterator to go over purge_files_ because inside the loop we're
-  // unlocking the mutex that protects purge_files_.
+  // Take everything queued so far in one go, files queued while the mutex
+  // is released are picked up by the next round.
   while (!purge_files_.empty()) {
-    auto it = purge_files_.begin();
-    // Need to make a copy of the PurgeFilesInfo before unlocking the mutex.
-    PurgeFileInfo purge_file = it->second;
-
-    const std::string& fname = purge_file.fname;
-    const std::string& dir_to_sync = purge_file.dir_to_sync;
-    FileType type = purge_file.type;
-    uint64_t number = purge_file.number;
-    int job_id = purge_file.job_id;
-
-    purge_files_.erase(it);
+    std::vector<PurgeFileInfo> batch;
+    batch.reserve(purge_files_.size());
+    for (const auto& it : purge_files_) {
+      batch.push_back(it.second);
+    }
+    purge_files_.clear();
 
     mutex_.Unlock();
-    DeleteObsoleteFileImpl(job_id, fname, dir_to_sync, type, number);
+    // Every file still goes through DeleteDBFile(), so SstFileManager rate
+    // limiting and trash apply as before. ZenFS then resets the zones the
+    // whole batch emptied in one pass.
+    for (const auto& f : batch) {
+      DeleteObsoleteFileImpl(f.job_id, f.fname, f.dir_to_sync, f.type,
+                             f.number);
+    }
+    auto hooks = GetZenFSHooks();
+    if (hooks->files_purged) {
+      hooks->files_purged();
+    }
     mutex_.Lock();
   }
 
@@ -2477,8 +2832,9 @@ Status DBImpl::MultiGetImpl(
     size_t batch_size = (keys_left > MultiGetContext::MAX_BATCH_SIZE)
                             ? MultiGetContext::MAX_BATCH_SIZE
                             : keys_left;
-    MultiGetContext ctx(sorted_keys, start_key + num_keys - keys_left,
-                        batch_size, snapshot, read_options);
+    size_t batch_start = start_key + num_keys - keys_left;
+    MultiGetContext ctx(sorted_keys, batch_start, batch_size, snapshot,
+                        read_options);
     MultiGetRange range = ctx.GetMultiGetRange();
     range.AddValueSize(curr_value_size);
     bool lookup_current = false;
@@ -2508,8 +2864,12 @@ Status DBImpl::MultiGetImpl(
     }
     if (lookup_current) {
       PERF_TIMER_GUARD(get_from_output_files_time);
-      super_version->current->MultiGet(read_options, &range, callback,
-                                       is_blob_index);
+      if (!MultiGetLanes(read_options, &range, sorted_keys, batch_start,
+                         batch_size, super_version, snapshot, callback,
+                         is_blob_index)) {
+        super_version->current->MultiGet(read_options, &range, callback,
+                                         is_blob_index);
+      }
     }
     curr_value_size = range.GetValueSize();
     if (curr_value_size > read_options.value_size_soft_limit) {
@@ -2549,6 +2909,144 @@ Status DBImpl::MultiGetImpl(
   return s;
 }
 
+bool DBImpl::MultiGetLanes(
+    const ReadOptions& read_options, MultiGetRange* range,
+    autovector<KeyContext*, MultiGetContext::MAX_BATCH_SIZE>* sorted_keys,
+    size_t batch_start, size_t batch_size, SuperVersion* super_version,
+    SequenceNumber snapshot, ReadCallback* callback, bool* is_blob_index) {
+  // [begin, end) of sorted_keys and the keys still to look up in it
+  struct LaneSpan {
+    size_t begin;
+    size_t end;
+    size_t keys;
+  };
+  size_t lanes = static_cast<size_t>(multiget_lanes_.load());
+  // is_blob_index is shared by all keys and cannot be written concurrently.
+  // Read callbacks, as used by transactions, keep state and are not safe
+  // to call from several lanes at once.
+  if (lanes < 2 || range->KeysLeft() < 2 || is_blob_index != nullptr ||
+      callback != nullptr) {
+    return false;
+  }
+  VersionStorageInfo* vstorage = super_version->current->storage_info();
+  int level = vstorage->num_non_empty_levels() - 1;
+  if (level <= 0) {
+    return false;
+  }
+  const LevelFilesBrief& files = vstorage->LevelFilesBrief(level);
+  const InternalKeyComparator& icmp =
+      super_version->cfd->internal_comparator();
+
+  std::unordered_set<KeyContext*> pending;
+  for (auto it = range->begin(); it != range->end(); ++it) {
+    pending.insert(&(*it));
+  }
+
+  // Keys are sorted, so each bottommost table gets a contiguous run
+  std::vector<LaneSpan> runs;
+  int last_file = -1;
+  for (size_t i = batch_start; i < batch_start + batch_size; i++) {
+    KeyContext* key = (*sorted_keys)[i];
+    if (!pending.count(key)) {
+      continue;
+    }
+    int file = FindFile(icmp, files, key->lkey->internal_key());
+    if (runs.empty() || file != last_file) {
+      if (!runs.empty()) {
+        runs.back().end = i;
+      }
+      runs.push_back({i, 0, 0});
+      last_file = file;
+    }
+    runs.back().keys++;
+  }
+  if (runs.size() < 2) {
+    return false;
+  }
+  runs.back().end = batch_start + batch_size;
+
+  std::vector<LaneSpan> spans;
+  size_t per_lane = (pending.size() + lanes - 1) / lanes;
+  for (const auto& r : runs) {
+    if (spans.empty() || spans.back().keys >= per_lane) {
+      spans.push_back(r);
+    } else {
+      spans.back().end = r.end;
+      spans.back().keys += r.keys;
+    }
+  }
+
+  // Every lane has its own context, so the per-context value accounting
+  // is never shared between threads. Version::MultiGet() checks
+  // value_size_soft_limit per context, so each lane gets an equal share of
+  // what is left of it and the batch as a whole stays within the limit.
+  uint64_t value_size = range->GetValueSize();
+  ReadOptions lane_options = read_options;
+  if (read_options.value_size_soft_limit > value_size) {
+    lane_options.value_size_soft_limit =
+        value_size +
+        (read_options.value_size_soft_limit - value_size) / spans.size();
+  }
+  std::vector<uint64_t> lane_bytes(spans.size(), 0);
+  struct SavedKey {
+    LookupKey* lkey;
+    Slice ukey;
+    Slice ikey;
+  };
+  auto run_lane = [&](size_t l) {
+    // The lane context points the keys' lkey/ukey/ikey into its own
+    // storage, put back the caller's before it goes out of scope.
+    std::vector<SavedKey> saved;
+    for (size_t i = spans[l].begin; i < spans[l].end; i++) {
+      KeyContext* key = (*sorted_keys)[i];
+      saved.push_back({key->lkey, key->ukey, key->ikey});
+    }
+    {
+      MultiGetContext ctx(sorted_keys, spans[l].begin,
+                          spans[l].end - spans[l].begin, snapshot,
+                          lane_options);
+      MultiGetRange lane_range = ctx.GetMultiGetRange();
+      for (auto it = lane_range.begin(); it != lane_range.end(); ++it) {
+        if (!pending.count(&(*it))) {
+          lane_range.SkipKey(it);
+        }
+      }
+      lane_range.AddValueSize(value_size);
+      super_version->current->MultiGet(lane_options, &lane_range, nullptr,
+                                       nullptr);
+      lane_bytes[l] = lane_range.GetValueSize() - value_size;
+    }
+    for (size_t i = spans[l].begin; i < spans[l].end; i++) {
+      const SavedKey& k = saved[i - spans[l].begin];
+      (*sorted_keys)[i]->lkey = k.lkey;
+      (*sorted_keys)[i]->ukey = k.ukey;
+      (*sorted_keys)[i]->ikey = k.ikey;
+    }
+  };
+
+  std::mutex done_mu;
+  std::condition_variable done_cv;
+  size_t running = spans.size() - 1;
+  for (size_t l = 1; l < spans.size(); l++) {
+    multiget_lane_pool_.SubmitJob([&, l]() {
+      run_lane(l);
+      std::lock_guard<std::mutex> lock(done_mu);
+      if (--running == 0) {
+        done_cv.notify_one();
+      }
+    });
+  }
+  run_lane(0);
+  {
+    std::unique_lock<std::mutex> lock(done_mu);
+    done_cv.wait(lock, [&running]() { return running == 0; });
+  }
+  for (auto b : lane_bytes) {
+    range->AddValueSize(b);
+  }
+  return true;
+}
+
 Status DBImpl::CreateColumnFamily(const ColumnFamilyOptions& cf_options,
                                   const std::string& column_family,
                                   ColumnFamilyHandle** handle) {
@@ -3013,6 +3511,114 @@ Status DBImpl::NewIterators(
   return Status::OK();
 }
 
+Status DBImpl::ParallelScan(const ReadOptions& read_options,
+                            ColumnFamilyHandle* column_family,
+                            const ParallelScanOptions& scan_options,
+                            const ParallelScanCallback& callback) {
+  // [lower, upper) of one partition, empty strings are open ends
+  struct ScanPartition {
+    std::string lower;
+    std::string upper;
+    uint64_t zone;
+  };
+  if (read_options.tailing || read_options.managed) {
+    return Status::NotSupported("ParallelScan needs a point-in-time view");
+  }
+  auto cfd = static_cast_with_check<ColumnFamilyHandleImpl>(column_family)
+                 ->cfd();
+  auto hooks = GetZenFSHooks();
+  std::vector<ScanPartition> partitions;
+  {
+    SuperVersion* sv = GetAndRefSuperVersion(cfd);
+    VersionStorageInfo* vstorage = sv->current->storage_info();
+    int level = vstorage->num_non_empty_levels() - 1;
+    std::vector<FileMetaData*> files;
+    if (level > 0) {
+      files = vstorage->LevelFiles(level);
+    }
+    ScanPartition head;
+    head.zone = port::kMaxUint64;
+    partitions.push_back(head);
+    for (size_t i = 0; i < files.size(); i++) {
+      uint64_t zone = hooks->file_zone
+                          ? hooks->file_zone(files[i]->fd.GetNumber())
+                          : port::kMaxUint64;
+      if (i == 0) {
+        partitions.back().zone = zone;
+        continue;
+      }
+      ScanPartition p;
+      p.lower = files[i]->smallest.user_key().ToString();
+      p.zone = zone;
+      partitions.back().upper = p.lower;
+      partitions.push_back(std::move(p));
+    }
+    ReturnAndCleanupSuperVersion(cfd, sv);
+  }
+  // Partitions on the same zone stay together and zones are visited in
+  // device order, so concurrent workers read mostly sequential ranges.
+  std::stable_sort(partitions.begin(), partitions.end(),
+                   [](const ScanPartition& a, const ScanPartition& b) {
+                     return a.zone < b.zone;
+                   });
+
+  // All workers read the same sequence number
+  ReadOptions ro = read_options;
+  const Snapshot* snapshot = nullptr;
+  if (ro.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    ro.snapshot = snapshot;
+  }
+
+  Status s;
+  std::mutex status_mu;
+  std::atomic<size_t> next_partition(0);
+  std::atomic<bool> stop(false);
+  auto scan_worker = [&](int worker) {
+    while (!stop.load(std::memory_order_relaxed)) {
+      size_t idx = next_partition.fetch_add(1);
+      if (idx >= partitions.size()) break;
+      const ScanPartition& p = partitions[idx];
+      ReadOptions pro = ro;
+      Slice lower(p.lower);
+      Slice upper(p.upper);
+      pro.iterate_lower_bound = p.lower.empty() ? nullptr : &lower;
+      pro.iterate_upper_bound = p.upper.empty() ? nullptr : &upper;
+      std::unique_ptr<Iterator> iter(NewIterator(pro, column_family));
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (!callback(worker, iter->key(), iter->value())) {
+          stop = true;
+          break;
+        }
+        if (stop.load(std::memory_order_relaxed)) break;
+      }
+      Status iter_s = iter->status();
+      if (!iter_s.ok() || shutting_down_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(status_mu);
+        if (s.ok()) {
+          s = iter_s.ok() ? Status::ShutdownInProgress() : iter_s;
+        }
+        stop = true;
+      }
+    }
+  };
+  size_t nr_threads = static_cast<size_t>(std::max(scan_options.threads, 1));
+  nr_threads = std::min(nr_threads, partitions.size());
+  std::vector<port::Thread> workers;
+  for (size_t i = 1; i < nr_threads; i++) {
+    workers.emplace_back(scan_worker, static_cast<int>(i));
+  }
+  scan_worker(0);
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+  return s;
+}
+
 const Snapshot* DBImpl::GetSnapshot() { return GetSnapshotImpl(false); }
 
 #ifndef ROCKSDB_LITE
@@ -3182,6 +3788,93 @@ Status DBImpl::EndIOTrace() {
   return Status::OK();
 }
 
+Status DBImpl::StartZenFSTrace(Env* env, const TraceOptions& trace_options,
+                               std::unique_ptr<TraceWriter>&& trace_writer) {
+  assert(trace_writer != nullptr);
+  auto hooks = GetZenFSHooks();
+  if (!hooks->start_trace) {
+    return Status::NotSupported("No ZenFS device attached");
+  }
+  Status s = hooks->start_trace(env, trace_options, std::move(trace_writer));
+  if (s.ok()) {
+    zenfs_tracing_.store(true);
+  }
+  return s;
+}
+
+Status DBImpl::EndZenFSTrace() {
+  zenfs_tracing_.store(false);
+  auto hooks = GetZenFSHooks();
+  if (!hooks->end_trace) {
+    return Status::NotSupported("No ZenFS device attached");
+  }
+  return hooks->end_trace();
+}
+
+void DBImpl::TraceZenFSCompaction(const CompactionJobInfo& info) {
+  auto hooks = GetZenFSHooks();
+  if (!hooks->trace_compaction ||
+      !zenfs_tracing_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::vector<uint64_t> inputs;
+  std::vector<uint64_t> outputs;
+  for (const auto& f : info.input_file_infos) {
+    inputs.push_back(f.file_number);
+  }
+  for (const auto& f : info.output_file_infos) {
+    outputs.push_back(f.file_number);
+  }
+  TraceZenFSTables(outputs);
+  hooks->trace_compaction(info.job_id, inputs, outputs);
+}
+
+void DBImpl::TraceZenFSTables(const std::vector<uint64_t>& file_numbers) {
+  struct TracedTable {
+    uint64_t number;
+    int level;
+    Env::WriteLifeTimeHint lifetime;
+    std::string smallest;
+    std::string largest;
+    uint64_t size;
+  };
+  auto hooks = GetZenFSHooks();
+  if (!hooks->trace_table_file ||
+      !zenfs_tracing_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::vector<TracedTable> tables;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    for (uint64_t number : file_numbers) {
+      int level;
+      FileMetaData* meta;
+      ColumnFamilyData* cfd;
+      // Already compacted away again, its deletion is traced on its own
+      if (!versions_->GetMetadataForFile(number, &level, &meta, &cfd).ok()) {
+        continue;
+      }
+      tables.push_back({number, level, cfd->CalculateSSTWriteHint(level),
+                        meta->smallest.user_key().ToString(),
+                        meta->largest.user_key().ToString(),
+                        meta->fd.GetFileSize()});
+    }
+  }
+  // The device takes its own locks, so it is told without mutex_
+  for (const auto& t : tables) {
+    hooks->trace_table_file(t.number, t.level, t.lifetime, t.smallest,
+                            t.largest, t.size);
+  }
+}
+
+void DBImpl::TraceZenFSTableDeleted(uint64_t file_number) {
+  auto hooks = GetZenFSHooks();
+  if (hooks->trace_table_deleted &&
+      zenfs_tracing_.load(std::memory_order_relaxed)) {
+    hooks->trace_table_deleted(file_number);
+  }
+}
+
 #endif  // ROCKSDB_LITE
 
 Options DBImpl::GetOptions(ColumnFamilyHandle* column_family) const {
@@ -3198,6 +3891,10 @@ DBOptions DBImpl::GetDBOptions() const {
 
 bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
                          const Slice& property, std::string* value) {
+  if (property.starts_with(kZenFSPropertyPrefix)) {
+    value->clear();
+    return GetZenFSProperty(property, value, nullptr);
+  }
   const DBPropertyInfo* property_info = GetPropertyInfo(property);
   value->clear();
   auto cfd =
@@ -3233,6 +3930,10 @@ bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
 bool DBImpl::GetMapProperty(ColumnFamilyHandle* column_family,
                             const Slice& property,
                             std::map<std::string, std::string>* value) {
+  if (property.starts_with(kZenFSPropertyPrefix)) {
+    value->clear();
+    return GetZenFSProperty(property, nullptr, value);
+  }
   const DBPropertyInfo* property_info = GetPropertyInfo(property);
   value->clear();
   auto cfd =
@@ -3251,6 +3952,14 @@ bool DBImpl::GetMapProperty(ColumnFamilyHandle* column_family,
 
 bool DBImpl::GetIntProperty(ColumnFamilyHandle* column_family,
                             const Slice& property, uint64_t* value) {
+  if (property.starts_with(kZenFSPropertyPrefix)) {
+    std::string str_value;
+    if (!GetZenFSProperty(property, &str_value, nullptr)) {
+      return false;
+    }
+    Slice in(str_value);
+    return ConsumeDecimalNumber(&in, value) && in.empty();
+  }
   const DBPropertyInfo* property_info = GetPropertyInfo(property);
   if (property_info == nullptr || property_info->handle_int == nullptr) {
     return false;
@@ -3291,6 +4000,19 @@ bool DBImpl::GetIntPropertyInternal(ColumnFamilyData* cfd,
   }
 }
 
+// The zoned block device keeps its own atomic counters, so these never take
+// the DB mutex.
+bool DBImpl::GetZenFSProperty(const Slice& property, std::string* value,
+                              std::map<std::string, std::string>* map_value) {
+  auto hooks = GetZenFSHooks();
+  if (!hooks->get_property) {
+    return false;
+  }
+  Slice name = property;
+  name.remove_prefix(kZenFSPropertyPrefix.size());
+  return hooks->get_property(name.ToString(), value, map_value);
+}
+
 bool DBImpl::GetPropertyHandleOptionsStatistics(std::string* value) {
   assert(value != nullptr);
   Statistics* statistics = immutable_db_options_.statistics.get();
@@ -3466,12 +4188,26 @@ Status DBImpl::GetApproximateSizes(const SizeApproximationOptions& options,
   SuperVersion* sv = GetAndRefSuperVersion(cfd);
   v = sv->current;
 
+  // Callers accepting an error margin are answered from the sampled table
+  // summaries without reading index blocks.
+  std::shared_ptr<const TableSizeSummaryMap> summaries;
+  std::vector<uint64_t> missing;
+  if (options.include_files && options.files_size_error_margin > 0) {
+    summaries = std::atomic_load(&size_summaries_);
+    if (!summaries) {
+      summaries = std::make_shared<const TableSizeSummaryMap>();
+    }
+  }
+
   for (int i = 0; i < n; i++) {
     // Convert user_key into a corresponding internal key.
     InternalKey k1(range[i].start, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey k2(range[i].limit, kMaxSequenceNumber, kValueTypeForSeek);
     sizes[i] = 0;
-    if (options.include_files) {
+    if (summaries) {
+      sizes[i] += ApproximateSizeFromSummaries(
+          cfd, sv, *summaries, k1.Encode(), k2.Encode(), &missing);
+    } else if (options.include_files) {
       sizes[i] += versions_->ApproximateSize(
           options, v, k1.Encode(), k2.Encode(), /*start_level=*/0,
           /*end_level=*/-1, TableReaderCaller::kUserApproximateSize);
@@ -3481,11 +4217,222 @@ Status DBImpl::GetApproximateSizes(const SizeApproximationOptions& options,
       sizes[i] += sv->imm->ApproximateStats(k1.Encode(), k2.Encode()).size;
     }
   }
+  if (!missing.empty()) {
+    InstrumentedMutexLock l(&mutex_);
+    ScheduleTableSizeSummaries(cfd, missing);
+  }
 
   ReturnAndCleanupSuperVersion(cfd, sv);
   return Status::OK();
 }
 
+namespace {
+// Most sampled keys kept per table file
+const size_t kSizeSummaryMaxAnchors = 32;
+
+// Offset of key in a summarized file. The file bounds act as anchors at 0
+// and the file size, a key between two anchors is put half way.
+uint64_t SummaryOffsetOf(const InternalKeyComparator& icmp,
+                         const FdWithKeyRange& f,
+                         const std::string* anchors, const uint64_t* offsets,
+                         size_t nr_anchors, const Slice& key) {
+  if (icmp.Compare(key, f.smallest_key) <= 0) {
+    return 0;
+  }
+  if (icmp.Compare(key, f.largest_key) > 0) {
+    return f.fd.GetFileSize();
+  }
+  const std::string* it = std::upper_bound(
+      anchors, anchors + nr_anchors, key,
+      [&icmp](const Slice& k, const std::string& a) {
+        return icmp.Compare(k, a) < 0;
+      });
+  size_t i = it - anchors;
+  uint64_t lo = i == 0 ? 0 : offsets[i - 1];
+  uint64_t hi = i == nr_anchors ? f.fd.GetFileSize() : offsets[i];
+  if (i > 0 && icmp.Compare(key, anchors[i - 1]) == 0) {
+    return lo;
+  }
+  return lo + (hi > lo ? (hi - lo) / 2 : 0);
+}
+}  // namespace
+
+uint64_t DBImpl::ApproximateSizeFromSummaries(
+    ColumnFamilyData* cfd, SuperVersion* sv,
+    const TableSizeSummaryMap& summaries, const Slice& start,
+    const Slice& end, std::vector<uint64_t>* missing) {
+  const InternalKeyComparator& icmp = cfd->internal_comparator();
+  VersionStorageInfo* vstorage = sv->current->storage_info();
+  uint64_t total = 0;
+
+  for (int level = 0; level < vstorage->num_non_empty_levels(); level++) {
+    const LevelFilesBrief& files = vstorage->LevelFilesBrief(level);
+    size_t idx = level > 0 ? FindFile(icmp, files, start) : 0;
+    for (; idx < files.num_files; idx++) {
+      const FdWithKeyRange& f = files.files[idx];
+      if (icmp.Compare(f.smallest_key, end) >= 0) {
+        if (level > 0) {
+          break;
+        }
+        continue;
+      }
+      if (icmp.Compare(f.largest_key, start) < 0) {
+        continue;
+      }
+      if (icmp.Compare(f.smallest_key, start) >= 0 &&
+          icmp.Compare(f.largest_key, end) < 0) {
+        total += f.fd.GetFileSize();
+        continue;
+      }
+
+      uint64_t lo, hi;
+      auto it = summaries.find(f.fd.GetNumber());
+      if (it != summaries.end()) {
+        const TableSizeSummary& s = *it->second;
+        lo = SummaryOffsetOf(icmp, f, s.anchors.data(), s.offsets.data(),
+                             s.anchors.size(), start);
+        hi = SummaryOffsetOf(icmp, f, s.anchors.data(), s.offsets.data(),
+                             s.anchors.size(), end);
+      } else {
+        // Exact index lookups until the summary is built
+        const SliceTransform* pe =
+            sv->mutable_cf_options.prefix_extractor.get();
+        lo = cfd->table_cache()->ApproximateOffsetOf(
+            start, f.fd, TableReaderCaller::kUserApproximateSize, icmp, pe);
+        hi = cfd->table_cache()->ApproximateOffsetOf(
+            end, f.fd, TableReaderCaller::kUserApproximateSize, icmp, pe);
+        missing->push_back(f.fd.GetNumber());
+      }
+      total += hi > lo ? hi - lo : 0;
+    }
+  }
+  return total;
+}
+
+void DBImpl::ScheduleTableSizeSummaries(
+    ColumnFamilyData* cfd, const std::vector<uint64_t>& file_numbers) {
+  mutex_.AssertHeld();
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    return;
+  }
+  auto& pending = size_summary_pending_[cfd->GetID()];
+  pending.insert(file_numbers.begin(), file_numbers.end());
+  if (bg_size_summary_scheduled_ == 0) {
+    bg_size_summary_scheduled_++;
+    env_->Schedule(&DBImpl::BGWorkSizeSummary, this, Env::Priority::LOW,
+                   nullptr);
+  }
+}
+
+void DBImpl::BGWorkSizeSummary(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCallSizeSummary();
+}
+
+void DBImpl::BackgroundCallSizeSummary() {
+  mutex_.Lock();
+  while (!size_summary_pending_.empty() &&
+         !shutting_down_.load(std::memory_order_acquire)) {
+    auto it = size_summary_pending_.begin();
+    uint32_t cf_id = it->first;
+    std::vector<uint64_t> file_numbers(it->second.begin(), it->second.end());
+    size_summary_pending_.erase(it);
+
+    auto cfd = versions_->GetColumnFamilySet()->GetColumnFamily(cf_id);
+    if (cfd == nullptr || cfd->IsDropped()) {
+      continue;
+    }
+    cfd->Ref();
+    mutex_.Unlock();
+    SuperVersion* sv = GetAndRefSuperVersion(cfd);
+    BuildTableSizeSummaries(cfd, sv, file_numbers);
+    ReturnAndCleanupSuperVersion(cfd, sv);
+    mutex_.Lock();
+    cfd->UnrefAndTryDelete();
+  }
+  size_summary_pending_.clear();
+  bg_size_summary_scheduled_--;
+  bg_cv_.SignalAll();
+  // No code after SignalAll, the DB may be destroyed once it is seen.
+  mutex_.Unlock();
+}
+
+void DBImpl::BuildTableSizeSummaries(ColumnFamilyData* cfd, SuperVersion* sv,
+                                     const std::vector<uint64_t>& file_numbers) {
+  const InternalKeyComparator& icmp = cfd->internal_comparator();
+  VersionStorageInfo* vstorage = sv->current->storage_info();
+  const SliceTransform* pe = sv->mutable_cf_options.prefix_extractor.get();
+  std::unordered_set<uint64_t> wanted(file_numbers.begin(),
+                                      file_numbers.end());
+  std::unordered_set<uint64_t> live;
+  std::vector<std::shared_ptr<const TableSizeSummary>> built;
+  std::vector<uint64_t> built_numbers;
+
+  for (int level = 0; level < vstorage->num_levels(); level++) {
+    const LevelFilesBrief& files = vstorage->LevelFilesBrief(level);
+    for (size_t i = 0; i < files.num_files; i++) {
+      const FdWithKeyRange& f = files.files[i];
+      live.insert(f.fd.GetNumber());
+      if (!wanted.count(f.fd.GetNumber())) {
+        continue;
+      }
+      // Anchor at the boundaries of the other files inside this one, the
+      // adjacent levels alone leave L0 and the last level without any.
+      std::vector<std::string> keys;
+      for (int nlevel = 0; nlevel < vstorage->num_non_empty_levels();
+           nlevel++) {
+        const LevelFilesBrief& nfiles = vstorage->LevelFilesBrief(nlevel);
+        for (size_t j = 0; j < nfiles.num_files; j++) {
+          if (nfiles.files[j].fd.GetNumber() == f.fd.GetNumber()) {
+            continue;
+          }
+          for (const Slice& k :
+               {nfiles.files[j].smallest_key, nfiles.files[j].largest_key}) {
+            if (icmp.Compare(k, f.smallest_key) > 0 &&
+                icmp.Compare(k, f.largest_key) < 0) {
+              keys.push_back(k.ToString());
+            }
+          }
+        }
+      }
+      std::sort(keys.begin(), keys.end(),
+                [&icmp](const std::string& a, const std::string& b) {
+                  return icmp.Compare(a, b) < 0;
+                });
+      auto summary = std::make_shared<TableSizeSummary>();
+      summary->cf_id = cfd->GetID();
+      summary->file_size = f.fd.GetFileSize();
+      size_t step = keys.size() / kSizeSummaryMaxAnchors + 1;
+      for (size_t j = 0; j < keys.size(); j += step) {
+        uint64_t off = cfd->table_cache()->ApproximateOffsetOf(
+            keys[j], f.fd, TableReaderCaller::kUserApproximateSize, icmp, pe);
+        if (!summary->offsets.empty() && off < summary->offsets.back()) {
+          off = summary->offsets.back();
+        }
+        summary->anchors.push_back(std::move(keys[j]));
+        summary->offsets.push_back(off);
+      }
+      built.push_back(summary);
+      built_numbers.push_back(f.fd.GetNumber());
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(size_summary_mu_);
+  auto cur = std::atomic_load(&size_summaries_);
+  auto next = std::make_shared<TableSizeSummaryMap>();
+  if (cur) {
+    for (const auto& e : *cur) {
+      if (e.second->cf_id != cfd->GetID() || live.count(e.first)) {
+        next->insert(e);
+      }
+    }
+  }
+  for (size_t i = 0; i < built.size(); i++) {
+    (*next)[built_numbers[i]] = built[i];
+  }
+  std::atomic_store(&size_summaries_,
+                    std::shared_ptr<const TableSizeSummaryMap>(next));
+}
+
 std::list<uint64_t>::iterator
 DBImpl::CaptureCurrentFileNumberInPendingOutputs() {
   // We need to remember the iterator of our insert, because after the
@@ -4819,6 +5766,17 @@ Status DBImpl::CreateColumnFamilyWithImport(
 }
 
 Status DBImpl::VerifyChecksum(const ReadOptions& read_options) {
+  return VerifyChecksum(read_options, VerifyChecksumOptions());
+}
+
+Status DBImpl::VerifyChecksum(const ReadOptions& read_options,
+                              const VerifyChecksumOptions& verify_options) {
+  struct VerifyTask {
+    std::string fname;
+    uint64_t size;
+    uint64_t zone;
+    size_t opts_idx;
+  };
   Status s;
   std::vector<ColumnFamilyData*> cfd_list;
   {
@@ -4834,28 +5792,104 @@ Status DBImpl::VerifyChecksum(const ReadOptions& read_options) {
   for (auto cfd : cfd_list) {
     sv_list.push_back(cfd->GetReferencedSuperVersion(this));
   }
+  std::vector<Options> opts_list;
+  std::vector<VerifyTask> tasks;
+  uint64_t bytes_total = 0;
+  auto hooks = GetZenFSHooks();
   for (auto& sv : sv_list) {
     VersionStorageInfo* vstorage = sv->current->storage_info();
     ColumnFamilyData* cfd = sv->current->cfd();
-    Options opts;
     {
       InstrumentedMutexLock l(&mutex_);
-      opts = Options(BuildDBOptions(immutable_db_options_, mutable_db_options_),
-                     cfd->GetLatestCFOptions());
+      opts_list.emplace_back(
+          BuildDBOptions(immutable_db_options_, mutable_db_options_),
+          cfd->GetLatestCFOptions());
     }
-    for (int i = 0; i < vstorage->num_non_empty_levels() && s.ok(); i++) {
-      for (size_t j = 0; j < vstorage->LevelFilesBrief(i).num_files && s.ok();
-           j++) {
+    for (int i = 0; i < vstorage->num_non_empty_levels(); i++) {
+      for (size_t j = 0; j < vstorage->LevelFilesBrief(i).num_files; j++) {
         const auto& fd = vstorage->LevelFilesBrief(i).files[j].fd;
-        std::string fname = TableFileName(cfd->ioptions()->cf_paths,
-                                          fd.GetNumber(), fd.GetPathId());
-        s = ROCKSDB_NAMESPACE::VerifySstFileChecksum(opts, file_options_,
-                                                     read_options, fname);
+        VerifyTask t;
+        t.fname = TableFileName(cfd->ioptions()->cf_paths, fd.GetNumber(),
+                                fd.GetPathId());
+        t.size = fd.GetFileSize();
+        t.zone = hooks->file_zone
+                     ? hooks->file_zone(fd.GetNumber())
+                     : port::kMaxUint64;
+        t.opts_idx = opts_list.size() - 1;
+        bytes_total += t.size;
+        tasks.push_back(std::move(t));
       }
     }
-    if (!s.ok()) {
-      break;
+  }
+  // Neighbouring files share zones, so walking zones in order keeps every
+  // thread reading forward. Files off ZenFS keep their level order.
+  std::stable_sort(tasks.begin(), tasks.end(),
+                   [](const VerifyTask& a, const VerifyTask& b) {
+                     return a.zone < b.zone;
+                   });
+
+  std::unique_ptr<RateLimiter> limiter;
+  if (verify_options.rate_bytes_per_sec > 0) {
+    // The default mode only charges writes, the sweep requests kRead.
+    limiter.reset(NewGenericRateLimiter(
+        static_cast<int64_t>(verify_options.rate_bytes_per_sec),
+        100 * 1000 /* refill_period_us */, 10 /* fairness */,
+        RateLimiter::Mode::kReadsOnly));
+    assert(limiter->IsRateLimited(RateLimiter::OpType::kRead));
+  }
+  std::atomic<size_t> next_task(0);
+  std::atomic<bool> stop(false);
+  std::mutex progress_mu;
+  uint64_t files_done = 0;
+  uint64_t bytes_done = 0;
+  auto verify_worker = [&]() {
+    while (!stop.load(std::memory_order_relaxed)) {
+      if (shutting_down_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(progress_mu);
+        if (s.ok()) s = Status::ShutdownInProgress();
+        stop = true;
+        break;
+      }
+      size_t idx = next_task.fetch_add(1);
+      if (idx >= tasks.size()) break;
+      const VerifyTask& t = tasks[idx];
+      if (limiter) {
+        int64_t left = static_cast<int64_t>(t.size);
+        while (left > 0) {
+          int64_t chunk = std::min(left, limiter->GetSingleBurstBytes());
+          limiter->Request(chunk, Env::IO_LOW, nullptr /* stats */,
+                           RateLimiter::OpType::kRead);
+          left -= chunk;
+        }
+      }
+      Status file_s = ROCKSDB_NAMESPACE::VerifySstFileChecksum(
+          opts_list[t.opts_idx], file_options_, read_options, t.fname);
+
+      std::lock_guard<std::mutex> lock(progress_mu);
+      if (!file_s.ok()) {
+        if (s.ok()) s = file_s;
+        stop = true;
+        break;
+      }
+      files_done++;
+      bytes_done += t.size;
+      if (verify_options.progress &&
+          !verify_options.progress(files_done, tasks.size(), bytes_done,
+                                   bytes_total)) {
+        if (s.ok()) s = Status::Incomplete("VerifyChecksum cancelled");
+        stop = true;
+      }
     }
+  };
+  size_t nr_threads = static_cast<size_t>(std::max(verify_options.threads, 1));
+  nr_threads = std::min(nr_threads, std::max(tasks.size(), size_t{1}));
+  std::vector<port::Thread> workers;
+  for (size_t i = 1; i < nr_threads; i++) {
+    workers.emplace_back(verify_worker);
+  }
+  verify_worker();
+  for (auto& w : workers) {
+    w.join();
   }
   bool defer_purge =
           immutable_db_options().avoid_unnecessary_blocking_io;
@@ -16,6 +16,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <string>
@@ -67,6 +68,7 @@
 #include "util/repeatable_thread.h"
 #include "util/stop_watch.h"
 #include "util/thread_local.h"
+#include "util/threadpool_imp.h"
 
 namespace ROCKSDB_NAMESPACE {
 
@@ -85,6 +87,7 @@ class Version;
 class VersionEdit;
 class VersionSet;
 class WriteCallback;
+class ZenFSTraceListener;
 struct JobContext;
 struct ExternalSstFileInfo;
 struct MemTableInfo;
@@ -121,6 +124,99 @@ class Directories {
   std::unique_ptr<FSDirectory> wal_dir_;
 };
 
+// Callbacks installed by the zoned block device (ZenFS) when it is attached
+// to the DB. They let DBImpl surface device state without depending on the
+// ZenFS headers. Any of them may be empty.
+struct ZenFSHooks {
+  // Serves the "rocksdb.zenfs.<name>" properties. Either output may be null.
+  std::function<bool(const std::string& name, std::string* value,
+                     std::map<std::string, std::string>* map_value)>
+      get_property;
+  // Adds monotonic device counters to a PersistStats() slice.
+  std::function<void(std::map<std::string, uint64_t>* stats)> get_stats_map;
+  // Appends human readable device stats (histograms) to DumpStats().
+  std::function<void(std::string* out)> dump_stats;
+  // File lifecycle trace for offline placement studies.
+  std::function<Status(Env* env, const TraceOptions& options,
+                       std::unique_ptr<TraceWriter>&& trace_writer)>
+      start_trace;
+  std::function<Status()> end_trace;
+  std::function<void(uint64_t job_id, const std::vector<uint64_t>& inputs,
+                     const std::vector<uint64_t>& outputs)>
+      trace_compaction;
+  // A table file a flush or compaction installed, traced as created,
+  // appended to with its whole size and closed.
+  std::function<void(uint64_t file_number, int level,
+                     Env::WriteLifeTimeHint lifetime, const Slice& smallest,
+                     const Slice& largest, uint64_t file_size)>
+      trace_table_file;
+  std::function<void(uint64_t file_number)> trace_table_deleted;
+  // Applies the "zenfs_*" keys of SetOptions()/SetDBOptions().
+  std::function<Status(
+      const std::unordered_map<std::string, std::string>& options_map)>
+      set_options;
+  // Validates the same keys without applying them.
+  std::function<Status(
+      const std::unordered_map<std::string, std::string>& options_map)>
+      check_options;
+  // First zone holding a table file, UINT64_MAX when unknown. Zones are
+  // numbered in device order, so sorting by it gives sequential reads.
+  std::function<uint64_t(uint64_t file_number)> file_zone;
+  // For every set of table files, the zones left without valid data if
+  // all files of the set were deleted, i.e. what ZenFS could reset without
+  // GC copies. One call answers a whole batch of candidates.
+  std::function<void(const std::vector<std::vector<uint64_t>>& file_sets,
+                     std::vector<uint64_t>* zones_freed)>
+      zone_reclaim_benefit;
+  // Whether MaybeDrainZones() also marks the compaction freeing the most
+  // zones. Off unless zenfs_gc_co_schedule is set.
+  std::function<bool()> co_schedule;
+  // Table files pinning nearly invalid zones, which the DB should compact
+  // so those zones empty without GC copies. Empty when draining is off.
+  std::function<void(std::vector<uint64_t>* file_numbers)> pinning_files;
+  // Files the DB newly marked for compaction to drain zones.
+  std::function<void(const std::vector<uint64_t>& file_numbers)>
+      drain_marked;
+  // Called without mutex_ after BackgroundCallPurge() deleted a batch of
+  // obsolete files, so the device resets the zones they emptied at once.
+  std::function<void()> files_purged;
+};
+
+// Tuning of DBImpl::VerifyChecksum(read_options, verify_options).
+struct VerifyChecksumOptions {
+  // Files verified concurrently, the calling thread is one of them.
+  int threads = 1;
+  // Read budget shared by all threads in bytes per second, 0 is unlimited.
+  uint64_t rate_bytes_per_sec = 0;
+  // Called after every verified file with running totals. Returning false
+  // stops the sweep and VerifyChecksum() returns Status::Incomplete().
+  std::function<bool(uint64_t files_done, uint64_t files_total,
+                     uint64_t bytes_done, uint64_t bytes_total)>
+      progress;
+};
+
+// Tuning of DBImpl::ParallelScan().
+struct ParallelScanOptions {
+  // Partitions scanned concurrently, the calling thread is one of them.
+  int threads = 4;
+};
+
+// A compaction of one file with its overlapping files in the next level,
+// scored by the zones its inputs would free. See
+// DBImpl::GetZoneReclaimCandidates().
+struct ZoneReclaimCandidate {
+  uint64_t file_number = 0;
+  // The file and its overlapping files in level + 1.
+  std::vector<uint64_t> inputs;
+  uint64_t input_bytes = 0;
+  uint64_t zones_freed = 0;
+};
+
+// Receives every record of a ParallelScan(). Called concurrently from all
+// workers, worker is in [0, threads). Returning false stops the scan.
+using ParallelScanCallback =
+    std::function<bool(int worker, const Slice& key, const Slice& value)>;
+
 // While DB is the public interface of RocksDB, and DBImpl is the actual
 // class implementing it. It's the entrance of the core RocksdB engine.
 // All other DB implementations, e.g. TransactionDB, BlobDB, etc, wrap a
@@ -155,6 +251,28 @@ class DBImpl : public DB {
   void GetAllOverlappingFiles(const InternalKey& s, const InternalKey& l, std::vector<uint64_t>& fno_list);
   void SameLevelFileList(const int, std::vector<uint64_t>&); 
   int Getlevel();
+  // Foreground write pressure for ZenFS GC pacing. Like the file list
+  // helpers above this reads the default column family without mutex_.
+  void GetZenFSWritePressure(bool* stopped, bool* delayed,
+                             uint64_t* delayed_write_rate,
+                             uint64_t* pending_compaction_bytes);
+  // Files of a level ranked by the zones their compaction would free, most
+  // first and cheaper inputs first on ties. With zenfs_gc_co_schedule set
+  // MaybeDrainZones() marks the top one for compaction. Takes mutex_.
+  // Files that are, or overlap files that are, being compacted are left
+  // out. Empty without a zoned device attached.
+  Status GetZoneReclaimCandidates(ColumnFamilyHandle* column_family,
+                                  int level,
+                                  std::vector<ZoneReclaimCandidate>* out);
+  // May be called while the DB is running, readers keep the hooks they
+  // loaded alive until they are done with them.
+  void SetZenFSHooks(const ZenFSHooks& hooks) {
+    std::atomic_store(&zenfs_hooks_,
+                      std::shared_ptr<const ZenFSHooks>(new ZenFSHooks(hooks)));
+  }
+  std::shared_ptr<const ZenFSHooks> GetZenFSHooks() const {
+    return std::atomic_load(&zenfs_hooks_);
+  }
   // ---- Implementations of the DB interface ----
   using DB::Resume;
   virtual Status Resume() override;
@@ -279,6 +397,13 @@ class DBImpl : public DB {
       const ReadOptions& options,
       const std::vector<ColumnFamilyHandle*>& column_families,
       std::vector<Iterator*>* iterators) override;
+  // Unordered full scan of a column family. The keyspace is cut at the
+  // table boundaries of the bottommost level and the partitions are handed
+  // to workers in the order of the zones holding those tables.
+  Status ParallelScan(const ReadOptions& read_options,
+                      ColumnFamilyHandle* column_family,
+                      const ParallelScanOptions& scan_options,
+                      const ParallelScanCallback& callback);
 
   virtual const Snapshot* GetSnapshot() override;
   virtual void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -448,6 +573,9 @@ class DBImpl : public DB {
 
   using DB::VerifyChecksum;
   virtual Status VerifyChecksum(const ReadOptions& /*read_options*/) override;
+  // Verifies all live table files in zone order with a pool of threads.
+  Status VerifyChecksum(const ReadOptions& read_options,
+                        const VerifyChecksumOptions& verify_options);
 
   using DB::StartTrace;
   virtual Status StartTrace(
@@ -472,6 +600,20 @@ class DBImpl : public DB {
   using DB::EndIOTrace;
   Status EndIOTrace() override;
 
+  // Start/stop the ZenFS file lifecycle trace (create, append, delete and
+  // compaction linkage). NotSupported when no ZenFS device is attached.
+  Status StartZenFSTrace(Env* env, const TraceOptions& options,
+                         std::unique_ptr<TraceWriter>&& trace_writer);
+  Status EndZenFSTrace();
+
+  // Records which files a finished compaction consumed and produced, its
+  // outputs are traced as new tables first.
+  void TraceZenFSCompaction(const CompactionJobInfo& info);
+  // Records table files installed by a flush or compaction, with level,
+  // user key range and write hint from the current version.
+  void TraceZenFSTables(const std::vector<uint64_t>& file_numbers);
+  void TraceZenFSTableDeleted(uint64_t file_number);
+
   using DB::GetPropertiesOfAllTables;
   virtual Status GetPropertiesOfAllTables(
       ColumnFamilyHandle* column_family,
@@ -1031,6 +1173,10 @@ class DBImpl : public DB {
   // flush LOG out of application buffer
   void FlushInfoLog();
 
+  // Marks the table files ZenFS reports as pinning nearly invalid zones
+  // for compaction.
+  void MaybeDrainZones();
+
  protected:
   const std::string dbname_;
   std::string db_id_;
@@ -1040,6 +1186,10 @@ class DBImpl : public DB {
   std::unique_ptr<VersionSet> versions_;
   // Flag to check whether we allocated and own the info log file
   bool own_info_log_;
+  // Feeds flush, compaction and table deletion events to the ZenFS
+  // lifecycle trace. Added to the listeners of initial_db_options_, so it
+  // is declared first.
+  std::shared_ptr<ZenFSTraceListener> zenfs_trace_listener_;
   const DBOptions initial_db_options_;
   Env* const env_;
   std::shared_ptr<IOTracer> io_tracer_;
@@ -1416,6 +1566,33 @@ class DBImpl : public DB {
                               const std::string& path_to_sync, FileType type,
                               uint64_t number);
 
+  // Approximate offsets of sampled keys of a table file. Immutable once
+  // published in size_summaries_.
+  struct TableSizeSummary {
+    uint32_t cf_id;
+    uint64_t file_size;
+    std::vector<std::string> anchors;  // internal keys, ascending
+    std::vector<uint64_t> offsets;     // offset of each anchor
+  };
+  using TableSizeSummaryMap =
+      std::unordered_map<uint64_t, std::shared_ptr<const TableSizeSummary>>;
+  // File bytes of [start, end) (internal keys) from the summaries. Boundary
+  // files without a summary are looked up in their index, the only I/O,
+  // and added to missing.
+  uint64_t ApproximateSizeFromSummaries(
+      ColumnFamilyData* cfd, SuperVersion* sv,
+      const TableSizeSummaryMap& summaries, const Slice& start,
+      const Slice& end, std::vector<uint64_t>* missing);
+  // Queues files for BackgroundCallSizeSummary(). REQUIRES: mutex_ held.
+  void ScheduleTableSizeSummaries(ColumnFamilyData* cfd,
+                                  const std::vector<uint64_t>& file_numbers);
+  static void BGWorkSizeSummary(void* arg);
+  void BackgroundCallSizeSummary();
+  // Builds summaries for the given files of sv's version and publishes
+  // them, dropping summaries of this column family's deleted files.
+  void BuildTableSizeSummaries(ColumnFamilyData* cfd, SuperVersion* sv,
+                               const std::vector<uint64_t>& file_numbers);
+
   // Background process needs to call
   //     auto x = CaptureCurrentFileNumberInPendingOutputs()
   //     auto file_num = versions_->NewFileNumber();
@@ -1725,6 +1902,18 @@ class DBImpl : public DB {
                               const DBPropertyInfo& property_info,
                               bool is_locked, uint64_t* value);
   bool GetPropertyHandleOptionsStatistics(std::string* value);
+  bool GetZenFSProperty(const Slice& property, std::string* value,
+                        std::map<std::string, std::string>* map_value);
+  // Splits the "zenfs_*" keys and "multiget_lanes" of input from the
+  // RocksDB options and validates them without changing anything.
+  Status CheckZenFSOptions(
+      const std::unordered_map<std::string, std::string>& input,
+      std::unordered_map<std::string, std::string>* zenfs_options,
+      std::unordered_map<std::string, std::string>* options_map);
+  // Applies keys accepted by CheckZenFSOptions(), the device ones through
+  // the ZenFS hooks.
+  Status ApplyZenFSOptions(
+      const std::unordered_map<std::string, std::string>& zenfs_options);
 
   bool HasPendingManualCompaction();
   bool HasExclusiveManualCompaction();
@@ -1839,6 +2028,18 @@ class DBImpl : public DB {
       SuperVersion* sv, SequenceNumber snap_seqnum, ReadCallback* callback,
       bool* is_blob_index);
 
+  // Looks up the keys left in range across up to multiget_lanes_ threads,
+  // one lane per run of keys that land in the same bottommost table, so
+  // the lanes' block reads are outstanding on the device together.
+  // Returns false, with nothing done, when the batch does not split or has
+  // a read callback.
+  bool MultiGetLanes(
+      const ReadOptions& read_options, MultiGetRange* range,
+      autovector<KeyContext*, MultiGetContext::MAX_BATCH_SIZE>* sorted_keys,
+      size_t batch_start, size_t batch_size, SuperVersion* sv,
+      SequenceNumber snap_seqnum, ReadCallback* callback,
+      bool* is_blob_index);
+
   Status DisableFileDeletionsWithLock();
 
   // table_cache_ provides its own synchronization
@@ -1946,6 +2147,12 @@ class DBImpl : public DB {
 
   bool stats_slice_initialized_ = false;
 
+  // Threads a MultiGet batch may use for table lookups, set by the
+  // "multiget_lanes" option. 1 keeps lookups on the caller.
+  std::atomic<int> multiget_lanes_{1};
+  // Runs every lane but the caller's, sized with multiget_lanes_.
+  ThreadPoolImpl multiget_lane_pool_;
+
   Directories directories_;
 
   WriteBufferManager* write_buffer_manager_;
@@ -2006,6 +2213,13 @@ class DBImpl : public DB {
   // ColumnFamilyData::pending_compaction_ == true)
   std::deque<ColumnFamilyData*> compaction_queue_;
 
+  // Table size summaries for GetApproximateSizes() by file number. Readers
+  // std::atomic_load() the map, writers copy it under size_summary_mu_.
+  std::shared_ptr<const TableSizeSummaryMap> size_summaries_;
+  std::mutex size_summary_mu_;
+  // Files waiting for a summary by column family ID, protected by mutex_.
+  std::map<uint32_t, std::unordered_set<uint64_t>> size_summary_pending_;
+
   // A map to store file numbers and filenames of the files to be purged
   std::unordered_map<uint64_t, PurgeFileInfo> purge_files_;
 
@@ -2038,6 +2252,9 @@ class DBImpl : public DB {
   // number of background obsolete file purge jobs, submitted to the HIGH pool
   int bg_purge_scheduled_;
 
+  // number of background table size summary jobs, submitted to the LOW pool
+  int bg_size_summary_scheduled_;
+
   std::deque<ManualCompactionState*> manual_compaction_dequeue_;
 
   // shall we disable deletion of obsolete files
@@ -2183,6 +2400,14 @@ class DBImpl : public DB {
   InstrumentedCondVar atomic_flush_install_cv_;
 
   bool wal_in_db_path_;
+
+  // Installed by ZonedBlockDevice::SetDBPointer(), possibly after the DB
+  // is open. Only accessed with std::atomic_load()/std::atomic_store().
+  std::shared_ptr<const ZenFSHooks> zenfs_hooks_ =
+      std::make_shared<const ZenFSHooks>();
+  // Between StartZenFSTrace() and EndZenFSTrace(), spares the version
+  // lookups of TraceZenFSTables() otherwise.
+  std::atomic<bool> zenfs_tracing_{false};
 };
 
 extern Options SanitizeOptions(const std::string& db, const Options& src);
@@ -0,0 +1,156 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "gc_options_zenfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace ROCKSDB_NAMESPACE {
+
+uint64_t ZenFSGCOptions::ZonesToReset(double free_pct, size_t nr_zones) const {
+  if (mode == ZENFS_GC_LAZY || free_pct > trigger_free_pct) return 0;
+  if (free_pct > light_free_pct) return nr_zones / light_reset_div;
+  if (free_pct > heavy_free_pct) return nr_zones / medium_reset_div;
+  return nr_zones / heavy_reset_div;
+}
+
+static bool ParsePct(const std::string &v, double *out) {
+  char *end;
+  double d = strtod(v.c_str(), &end);
+  if (v.empty() || *end != '\0' || d < 0 || d > 100) return false;
+  *out = d;
+  return true;
+}
+
+static bool ParseU32(const std::string &v, uint32_t *out) {
+  char *end;
+  unsigned long u = strtoul(v.c_str(), &end, 10);
+  if (v.empty() || *end != '\0' || u > UINT32_MAX) return false;
+  *out = (uint32_t)u;
+  return true;
+}
+
+static bool ParseDiv(const std::string &v, uint32_t *out) {
+  uint32_t u;
+  if (!ParseU32(v, &u) || u == 0) return false;
+  *out = u;
+  return true;
+}
+
+static bool ParseBool(const std::string &v, bool *out) {
+  if (v != "true" && v != "false" && v != "1" && v != "0") return false;
+  *out = (v == "true" || v == "1");
+  return true;
+}
+
+Status ZenFSGCOptions::Apply(
+    const std::unordered_map<std::string, std::string> &opts) {
+  ZenFSGCOptions n = *this;
+  const size_t plen = strlen(ZENFS_GC_OPTION_PREFIX);
+
+  for (const auto &o : opts) {
+    if (o.first.compare(0, plen, ZENFS_GC_OPTION_PREFIX) != 0)
+      return Status::InvalidArgument("Unknown ZenFS option", o.first);
+    const std::string key = o.first.substr(plen);
+    const std::string &v = o.second;
+    bool ok;
+
+    if (key == "mode") {
+      ok = (v == "eager" || v == "lazy");
+      n.mode = (v == "lazy") ? ZENFS_GC_LAZY : ZENFS_GC_EAGER;
+    } else if (key == "trigger_free_pct") {
+      ok = ParsePct(v, &n.trigger_free_pct);
+    } else if (key == "light_free_pct") {
+      ok = ParsePct(v, &n.light_free_pct);
+    } else if (key == "heavy_free_pct") {
+      ok = ParsePct(v, &n.heavy_free_pct);
+    } else if (key == "light_reset_div") {
+      ok = ParseDiv(v, &n.light_reset_div);
+    } else if (key == "medium_reset_div") {
+      ok = ParseDiv(v, &n.medium_reset_div);
+    } else if (key == "heavy_reset_div") {
+      ok = ParseDiv(v, &n.heavy_reset_div);
+    } else if (key == "log_copied") {
+      ok = ParseBool(v, &n.log_copied);
+    } else if (key == "adaptive") {
+      ok = ParseBool(v, &n.adaptive);
+    } else if (key == "critical_free_pct") {
+      ok = ParsePct(v, &n.critical_free_pct);
+    } else if (key == "min_rate_mb") {
+      ok = ParseU32(v, &n.min_rate_mb);
+    } else if (key == "max_rate_mb") {
+      ok = ParseU32(v, &n.max_rate_mb);
+    } else if (key == "reserve_min") {
+      ok = ParseU32(v, &n.reserve_min);
+    } else if (key == "reserve_max") {
+      ok = ParseU32(v, &n.reserve_max);
+    } else if (key == "victim") {
+      ok = (v == "greedy" || v == "cost_benefit");
+      n.victim = (v == "cost_benefit") ? ZENFS_GC_VICTIM_COST_BENEFIT
+                                       : ZENFS_GC_VICTIM_GREEDY;
+    } else if (key == "hot_read_heat") {
+      ok = ParseU32(v, &n.hot_read_heat);
+    } else if (key == "drain_valid_pct") {
+      ok = ParsePct(v, &n.drain_valid_pct);
+    } else if (key == "co_schedule") {
+      ok = ParseBool(v, &n.co_schedule);
+    } else if (key == "keep_valid_pct") {
+      ok = ParsePct(v, &n.keep_valid_pct) && n.keep_valid_pct > 0;
+    } else if (key == "streams") {
+      ok = ParseU32(v, &n.streams) && n.streams >= 1 &&
+           n.streams <= ZENFS_GC_STREAMS;
+    } else {
+      return Status::InvalidArgument("Unknown ZenFS GC option", o.first);
+    }
+
+    if (!ok) return Status::InvalidArgument("Bad value for " + o.first, v);
+  }
+
+  if (n.heavy_free_pct > n.light_free_pct)
+    return Status::InvalidArgument(
+        "zenfs_gc_heavy_free_pct must not exceed zenfs_gc_light_free_pct");
+
+  if (n.critical_free_pct > n.trigger_free_pct)
+    return Status::InvalidArgument(
+        "zenfs_gc_critical_free_pct must not exceed zenfs_gc_trigger_free_pct");
+  if (n.reserve_max && n.reserve_min > n.reserve_max)
+    return Status::InvalidArgument(
+        "zenfs_gc_reserve_min must not exceed zenfs_gc_reserve_max");
+  if (n.max_rate_mb && n.min_rate_mb > n.max_rate_mb)
+    return Status::InvalidArgument(
+        "zenfs_gc_min_rate_mb must not exceed zenfs_gc_max_rate_mb");
+
+  *this = n;
+  return Status::OK();
+}
+
+std::string ZenFSGCOptions::ToString() const {
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "mode=%s;trigger_free_pct=%.1f;light_free_pct=%.1f;"
+           "heavy_free_pct=%.1f;light_reset_div=%u;medium_reset_div=%u;"
+           "heavy_reset_div=%u;log_copied=%s;adaptive=%s;"
+           "critical_free_pct=%.1f;min_rate_mb=%u;max_rate_mb=%u;streams=%u;"
+           "reserve_min=%u;reserve_max=%u;victim=%s;keep_valid_pct=%.1f;"
+           "hot_read_heat=%u;drain_valid_pct=%.1f;co_schedule=%s",
+           mode == ZENFS_GC_LAZY ? "lazy" : "eager", trigger_free_pct,
+           light_free_pct, heavy_free_pct, light_reset_div, medium_reset_div,
+           heavy_reset_div, log_copied ? "true" : "false",
+           adaptive ? "true" : "false", critical_free_pct, min_rate_mb,
+           max_rate_mb, streams, reserve_min, reserve_max,
+           victim == ZENFS_GC_VICTIM_COST_BENEFIT ? "cost_benefit" : "greedy",
+           keep_valid_pct, hot_read_heat, drain_valid_pct,
+           co_schedule ? "true" : "false");
+  return buf;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,114 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <string>
+#include <unordered_map>
+
+#include "rocksdb/status.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+enum ZenFSGCMode {
+  ZENFS_GC_EAGER, /* clean zones inline in AllocateZone */
+  ZENFS_GC_LAZY,  /* never clean on the allocation path */
+};
+
+enum ZenFSGCVictim {
+  ZENFS_GC_VICTIM_GREEDY,       /* most invalid bytes first */
+  ZENFS_GC_VICTIM_COST_BENEFIT, /* most invalid bytes per valid byte moved */
+};
+
+/* Invalidated bytes are tracked per 1/ZENFS_ZONE_REGIONS of every zone */
+#define ZENFS_ZONE_REGIONS (8)
+
+/* Fixed point scale of the cost-benefit victim score */
+#define ZENFS_GC_CB_SCALE (1024)
+
+/* Most GC relocation streams, see ZonedBlockDevice::GCStreamFor() */
+#define ZENFS_GC_STREAMS (4)
+
+/* Most zones whose pinning SSTs are handed to the DB per drain round */
+#define ZENFS_GC_DRAIN_ZONES (4)
+
+/* Prefix of the GC keys accepted by DB::SetOptions()/SetDBOptions() */
+#define ZENFS_GC_OPTION_PREFIX "zenfs_gc_"
+
+/* Inline GC policy, changeable at runtime.
+ *
+ * Inline GC starts once free space drops to trigger_free_pct. The number
+ * of zones to reset is nr_zones / light_reset_div above light_free_pct,
+ * nr_zones / medium_reset_div above heavy_free_pct and
+ * nr_zones / heavy_reset_div below that.
+ */
+struct ZenFSGCOptions {
+  ZenFSGCMode mode = ZENFS_GC_EAGER;
+  double trigger_free_pct = 25.0;
+  double light_free_pct = 25.0;
+  double heavy_free_pct = 20.0;
+  uint32_t light_reset_div = 15;
+  uint32_t medium_reset_div = 10;
+  uint32_t heavy_reset_div = 5;
+  /* Report bytes copied by every cleaning pass */
+  bool log_copied = false;
+
+  /* Size and pace passes with GCRateController instead of the fixed
+   * tiers, cleaning then runs on the device GC thread. Copy bandwidth moves from min_rate_mb to max_rate_mb (MB/s)
+   * as free space falls from trigger_free_pct to critical_free_pct.
+   * max_rate_mb 0 leaves copying unthrottled. */
+  bool adaptive = false;
+  double critical_free_pct = 10.0;
+  uint32_t min_rate_mb = 16;
+  uint32_t max_rate_mb = 512;
+
+  /* Relocated extents are split into this many destination streams by
+   * level and lifetime, 1 puts all survivors into one zone like before.
+   * Every stream can keep a zone active. */
+  uint32_t streams = ZENFS_GC_STREAMS;
+
+  /* Bounds of the demand-sized free reserve, 0 keeps the defaults (a
+   * floor of 2, a ceiling of max(10, io zones / 64)) */
+  uint32_t reserve_min = 0;
+  uint32_t reserve_max = 0;
+
+  /* Victim ranking. Cost-benefit also keeps zones that are at least
+   * keep_valid_pct valid out of GC, finishing them when their unwritten
+   * room is no larger than what cleaning them would reclaim. */
+  ZenFSGCVictim victim = ZENFS_GC_VICTIM_GREEDY;
+  double keep_valid_pct = 90.0;
+
+  /* Zones read this often per heat half life are hot. A victim's
+   * priority is divided by 1 + heat / hot_read_heat, so hot zones are
+   * cleaned last, and hot victims are copied at half the adaptive rate.
+   * 0 ignores read heat. */
+  uint32_t hot_read_heat = 256;
+
+  /* Full zones at most drain_valid_pct valid that only hold SSTs have
+   * those SSTs compacted by the DB instead of being copied by GC, see
+   * ZonedBlockDevice::GetPinningFiles(). 0 turns draining off. */
+  double drain_valid_pct = 0.0;
+
+  /* Also have the DB compact, every drain tick, the file whose compaction
+   * leaves the most zones without valid data, see
+   * DBImpl::MaybeDrainZones(). */
+  bool co_schedule = false;
+
+  /* Zones to reset for the given free space, 0 when GC is not due */
+  uint64_t ZonesToReset(double free_pct, size_t nr_zones) const;
+
+  /* Apply zenfs_gc_* keys, any other key is InvalidArgument. Nothing
+   * changes unless every key parses. */
+  Status Apply(const std::unordered_map<std::string, std::string> &opts);
+
+  std::string ToString() const;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
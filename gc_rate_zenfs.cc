@@ -0,0 +1,128 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "gc_rate_zenfs.h"
+
+#include <algorithm>
+#include <thread>
+
+#define MB (1024 * 1024)
+
+/* Free space trend horizon: urgency is raised when the current trend would
+ * reach the critical level within this many seconds */
+#define ZENFS_GC_TREND_HORIZON_SEC (60.0)
+
+/* Weight of the newest sample in the smoothed trend */
+#define ZENFS_GC_TREND_ALPHA (0.3)
+
+/* Compaction debt above this is treated as foreground pressure */
+#define ZENFS_GC_PENDING_COMPACTION_BYTES (64ULL * 1024 * MB)
+
+/* Bucket depth in seconds of the current rate */
+#define ZENFS_GC_BURST_SEC (0.1)
+
+namespace ROCKSDB_NAMESPACE {
+
+GCRateController::GCRateController()
+    : urgency_(1.0),
+      rate_(0),
+      tokens_(0),
+      refill_(std::chrono::steady_clock::now()),
+      have_sample_(false),
+      last_free_pct_(0),
+      last_sample_(std::chrono::steady_clock::now()),
+      free_pct_per_sec_(0) {}
+
+double GCRateController::Urgency(double free_pct, const ZenFSGCOptions &opts) {
+  double span = opts.trigger_free_pct - opts.critical_free_pct;
+  double u = span > 0 ? (opts.trigger_free_pct - free_pct) / span : 1.0;
+
+  if (free_pct_per_sec_ < 0) {
+    double secs_left = (free_pct - opts.critical_free_pct) / -free_pct_per_sec_;
+    if (secs_left < ZENFS_GC_TREND_HORIZON_SEC)
+      u = std::max(u, 1.0 - secs_left / ZENFS_GC_TREND_HORIZON_SEC);
+  }
+  return std::min(1.0, std::max(0.0, u));
+}
+
+uint64_t GCRateController::Plan(double free_pct, size_t nr_zones,
+                                const ZenFSGCOptions &opts,
+                                const ZenFSWritePressure &pressure) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto now = std::chrono::steady_clock::now();
+
+  if (have_sample_) {
+    double secs =
+        std::chrono::duration<double>(now - last_sample_).count();
+    if (secs > 0) {
+      double slope = (free_pct - last_free_pct_) / secs;
+      free_pct_per_sec_ = ZENFS_GC_TREND_ALPHA * slope +
+                          (1 - ZENFS_GC_TREND_ALPHA) * free_pct_per_sec_;
+    }
+  }
+  have_sample_ = true;
+  last_free_pct_ = free_pct;
+  last_sample_ = now;
+
+  urgency_ = Urgency(free_pct, opts);
+
+  bool busy = pressure.stopped || pressure.delayed ||
+              pressure.pending_compaction_bytes >=
+                  ZENFS_GC_PENDING_COMPACTION_BYTES;
+
+  /* Interpolate the zone count between the light and heavy divisors */
+  double light = (double)nr_zones / opts.light_reset_div;
+  double heavy = (double)nr_zones / opts.heavy_reset_div;
+  double zones = light + (heavy - light) * urgency_;
+  if (busy && urgency_ < 0.5) zones /= 2;
+  uint64_t nr_reset = std::max<uint64_t>(1, (uint64_t)zones);
+
+  if (opts.max_rate_mb == 0 || urgency_ >= 1.0) {
+    rate_ = 0;
+  } else {
+    double min_rate = (double)opts.min_rate_mb * MB;
+    double max_rate = (double)opts.max_rate_mb * MB;
+    double rate = min_rate + (max_rate - min_rate) * urgency_;
+    if (busy) rate = std::max(min_rate, rate * (1.0 - (1.0 - urgency_) / 2));
+    rate_ = std::max<uint64_t>(MB, (uint64_t)rate);
+  }
+  return nr_reset;
+}
+
+uint64_t GCRateController::Request(uint64_t bytes) {
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (rate_ == 0) return 0;
+
+  auto now = std::chrono::steady_clock::now();
+  double burst = rate_ * ZENFS_GC_BURST_SEC;
+  tokens_ += std::chrono::duration<double>(now - refill_).count() * rate_;
+  tokens_ = std::min(tokens_, std::max(burst, (double)bytes));
+  refill_ = now;
+
+  tokens_ -= bytes;
+  if (tokens_ >= 0) return 0;
+
+  uint64_t micros = (uint64_t)(-tokens_ * 1000000.0 / rate_);
+  lk.unlock();
+  std::this_thread::sleep_for(std::chrono::microseconds(micros));
+  return micros;
+}
+
+double GCRateController::GetUrgency() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return urgency_;
+}
+
+uint64_t GCRateController::GetRate() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return rate_;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
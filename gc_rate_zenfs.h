@@ -0,0 +1,69 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "gc_options_zenfs.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/* Foreground state sampled from the DB before a cleaning pass */
+struct ZenFSWritePressure {
+  bool stopped = false;
+  bool delayed = false;
+  uint64_t delayed_write_rate = 0;
+  uint64_t pending_compaction_bytes = 0;
+};
+
+/* Sizes and paces the background GC passes.
+ *
+ * Urgency goes from 0 when free space is at the GC trigger to 1 at the
+ * critical level, and is pulled forward when the free space trend would
+ * reach the critical level soon. The pass size and the copy bandwidth are
+ * interpolated on urgency. While the DB is stalling or compaction debt is
+ * high and space is still comfortable, passes shrink and copying is
+ * slowed further. At full urgency GC runs unthrottled.
+ */
+class GCRateController {
+ public:
+  GCRateController();
+
+  /* Zones to reset in this pass, also retunes the copy rate */
+  uint64_t Plan(double free_pct, size_t nr_zones, const ZenFSGCOptions &opts,
+                const ZenFSWritePressure &pressure);
+
+  /* Token bucket, blocks until bytes may be copied. Returns micros slept. */
+  uint64_t Request(uint64_t bytes);
+
+  double GetUrgency();
+  uint64_t GetRate(); /* bytes/s, 0 is unlimited */
+
+ private:
+  double Urgency(double free_pct, const ZenFSGCOptions &opts);
+
+  std::mutex mtx_;
+  double urgency_;
+  uint64_t rate_;
+  double tokens_;
+  std::chrono::steady_clock::time_point refill_;
+
+  bool have_sample_;
+  double last_free_pct_;
+  std::chrono::steady_clock::time_point last_sample_;
+  double free_pct_per_sec_; /* smoothed, negative while space shrinks */
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
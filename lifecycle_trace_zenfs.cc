@@ -0,0 +1,361 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "lifecycle_trace_zenfs.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "util/coding.h"
+
+/* Events per thread ring, must be a power of two */
+#define ZENFS_TRACE_RING_SIZE (4096)
+
+/* How often the writer drains the rings */
+#define ZENFS_TRACE_DRAIN_MS (20)
+
+#define ZENFS_TRACE_MAGIC "ZenFSLifecycleTrace"
+#define ZENFS_TRACE_VERSION (1)
+
+namespace ROCKSDB_NAMESPACE {
+
+struct ZenFSTraceRing {
+  std::atomic<uint64_t> head; /* written by the owning thread */
+  std::atomic<uint64_t> tail; /* written by the drain */
+  std::atomic<bool> orphaned; /* the owning thread won't push any more */
+  ZenFSTraceEvent events[ZENFS_TRACE_RING_SIZE];
+
+  ZenFSTraceRing() : head(0), tail(0), orphaned(false) {}
+};
+
+static std::atomic<uint64_t> next_tracer_id(1);
+
+namespace {
+
+/* Ring of the last tracer this thread pushed to. Tracer ids are never
+ * reused, so a stale entry simply doesn't match. The tracer shares the
+ * ring; when the thread exits or moves on to another tracer the ring is
+ * orphaned, and the tracer frees it after draining it. The shared owner
+ * keeps the ring valid if the tracer goes away first. */
+struct TraceRingSlot {
+  uint64_t tracer_id = 0;
+  std::shared_ptr<ZenFSTraceRing> ring;
+
+  void Orphan() {
+    if (ring) ring->orphaned.store(true, std::memory_order_release);
+    ring.reset();
+    tracer_id = 0;
+  }
+  ~TraceRingSlot() { Orphan(); }
+};
+
+thread_local TraceRingSlot tls_trace_ring;
+
+}  // namespace
+
+ZenFSLifecycleTracer::ZenFSLifecycleTracer()
+    : id_(next_tracer_id.fetch_add(1)),
+      tracing_(false),
+      dropped_(0),
+      env_(nullptr),
+      max_trace_size_(0),
+      stop_(false) {}
+
+ZenFSLifecycleTracer::~ZenFSLifecycleTracer() {
+  End().PermitUncheckedError();
+}
+
+Status ZenFSLifecycleTracer::Start(Env *env, const TraceOptions &options,
+                                   std::unique_ptr<TraceWriter> &&writer) {
+  std::lock_guard<std::mutex> lk(writer_mtx_);
+  if (writer_) return Status::Busy("ZenFS lifecycle trace already started");
+
+  writer_ = std::move(writer);
+  env_ = env;
+  max_trace_size_ = options.max_trace_file_size;
+  stop_ = false;
+
+  std::string header, framed;
+  header.append(ZENFS_TRACE_MAGIC);
+  PutFixed32(&header, ZENFS_TRACE_VERSION);
+  PutFixed64(&header, env_->NowMicros());
+  PutLengthPrefixedSlice(&framed, header);
+  Status s = writer_->Write(framed);
+  if (!s.ok()) {
+    writer_.reset();
+    return s;
+  }
+
+  /* Throw away whatever raced with the previous End() */
+  {
+    std::lock_guard<std::mutex> rlk(rings_mtx_);
+    for (auto &r : rings_) r->tail.store(r->head.load());
+  }
+  PruneRings();
+
+  tracing_.store(true);
+  writer_thread_ = std::thread(&ZenFSLifecycleTracer::BackgroundWriter, this);
+  return Status::OK();
+}
+
+Status ZenFSLifecycleTracer::End() {
+  std::thread t;
+  {
+    std::lock_guard<std::mutex> lk(writer_mtx_);
+    if (!writer_) return Status::OK();
+    tracing_.store(false);
+    stop_ = true;
+    writer_cv_.notify_all();
+    t = std::move(writer_thread_);
+  }
+  if (t.joinable()) t.join();
+
+  std::lock_guard<std::mutex> lk(writer_mtx_);
+  Status s = writer_->Close();
+  writer_.reset();
+  return s;
+}
+
+ZenFSTraceRing *ZenFSLifecycleTracer::GetThreadRing() {
+  TraceRingSlot &slot = tls_trace_ring;
+  if (slot.tracer_id == id_) return slot.ring.get();
+
+  slot.Orphan();
+  std::shared_ptr<ZenFSTraceRing> ring = std::make_shared<ZenFSTraceRing>();
+  {
+    std::lock_guard<std::mutex> lk(rings_mtx_);
+    rings_.push_back(ring);
+  }
+  slot.tracer_id = id_;
+  slot.ring = ring;
+  return ring.get();
+}
+
+/* Drop the rings of threads that are gone once nothing is left in them */
+void ZenFSLifecycleTracer::PruneRings() {
+  std::lock_guard<std::mutex> lk(rings_mtx_);
+  rings_.erase(
+      std::remove_if(rings_.begin(), rings_.end(),
+                     [](const std::shared_ptr<ZenFSTraceRing> &r) {
+                       return r->orphaned.load(std::memory_order_acquire) &&
+                              r->tail.load() == r->head.load();
+                     }),
+      rings_.end());
+}
+
+void ZenFSLifecycleTracer::Push(ZenFSTraceEvent *ev) {
+  ZenFSTraceRing *b = GetThreadRing();
+  uint64_t head = b->head.load(std::memory_order_relaxed);
+
+  if (head - b->tail.load(std::memory_order_acquire) >=
+      ZENFS_TRACE_RING_SIZE) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ev->ts = env_->NowMicros();
+  b->events[head & (ZENFS_TRACE_RING_SIZE - 1)] = *ev;
+  b->head.store(head + 1, std::memory_order_release);
+}
+
+static void CopyKey(const Slice &key, char *dst, uint8_t *len) {
+  *len = (uint8_t)std::min<size_t>(key.size(), ZENFS_TRACE_KEY_LEN);
+  memcpy(dst, key.data(), *len);
+}
+
+void ZenFSLifecycleTracer::RecordCreate(uint64_t fno, int level,
+                                        Env::WriteLifeTimeHint lifetime,
+                                        const Slice &smallest,
+                                        const Slice &largest) {
+  if (!IsTracing()) return;
+  ZenFSTraceEvent ev;
+  ev.type = ZENFS_TRACE_CREATE;
+  ev.fno = fno;
+  ev.arg = 0;
+  ev.level = level;
+  ev.lifetime = (uint8_t)lifetime;
+  CopyKey(smallest, ev.smallest, &ev.smallest_len);
+  CopyKey(largest, ev.largest, &ev.largest_len);
+  Push(&ev);
+}
+
+static void SimpleEvent(ZenFSTraceEvent *ev, uint8_t type, uint64_t fno,
+                        uint64_t arg) {
+  ev->type = type;
+  ev->fno = fno;
+  ev->arg = arg;
+  ev->level = -1;
+  ev->lifetime = 0;
+  ev->smallest_len = 0;
+  ev->largest_len = 0;
+}
+
+void ZenFSLifecycleTracer::RecordAppend(uint64_t fno, uint64_t bytes) {
+  if (!IsTracing()) return;
+  ZenFSTraceEvent ev;
+  SimpleEvent(&ev, ZENFS_TRACE_APPEND, fno, bytes);
+  Push(&ev);
+}
+
+void ZenFSLifecycleTracer::RecordClose(uint64_t fno) {
+  if (!IsTracing()) return;
+  ZenFSTraceEvent ev;
+  SimpleEvent(&ev, ZENFS_TRACE_CLOSE, fno, 0);
+  Push(&ev);
+}
+
+void ZenFSLifecycleTracer::RecordDelete(uint64_t fno) {
+  if (!IsTracing()) return;
+  ZenFSTraceEvent ev;
+  SimpleEvent(&ev, ZENFS_TRACE_DELETE, fno, 0);
+  Push(&ev);
+}
+
+void ZenFSLifecycleTracer::RecordCompaction(
+    uint64_t job_id, const std::vector<uint64_t> &inputs,
+    const std::vector<uint64_t> &outputs) {
+  if (!IsTracing()) return;
+  ZenFSTraceEvent ev;
+  for (auto fno : inputs) {
+    SimpleEvent(&ev, ZENFS_TRACE_COMPACTION_INPUT, fno, job_id);
+    Push(&ev);
+  }
+  for (auto fno : outputs) {
+    SimpleEvent(&ev, ZENFS_TRACE_COMPACTION_OUTPUT, fno, job_id);
+    Push(&ev);
+  }
+}
+
+static void EncodeEvent(const ZenFSTraceEvent &ev, std::string *out) {
+  out->push_back((char)ev.type);
+  PutFixed64(out, ev.ts);
+  PutVarint64(out, ev.fno);
+  switch (ev.type) {
+    case ZENFS_TRACE_CREATE:
+      PutVarint32(out, (uint32_t)ev.level);
+      out->push_back((char)ev.lifetime);
+      PutLengthPrefixedSlice(out, Slice(ev.smallest, ev.smallest_len));
+      PutLengthPrefixedSlice(out, Slice(ev.largest, ev.largest_len));
+      break;
+    case ZENFS_TRACE_APPEND:
+    case ZENFS_TRACE_COMPACTION_INPUT:
+    case ZENFS_TRACE_COMPACTION_OUTPUT:
+      PutVarint64(out, ev.arg);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Called with writer_mtx_ held */
+void ZenFSLifecycleTracer::Drain() {
+  std::vector<std::shared_ptr<ZenFSTraceRing>> rings;
+  {
+    std::lock_guard<std::mutex> lk(rings_mtx_);
+    rings = rings_;
+  }
+
+  std::string record, framed;
+  for (auto &b : rings) {
+    uint64_t tail = b->tail.load(std::memory_order_relaxed);
+    uint64_t head = b->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      record.clear();
+      framed.clear();
+      EncodeEvent(b->events[tail & (ZENFS_TRACE_RING_SIZE - 1)], &record);
+      if (max_trace_size_ && writer_->GetFileSize() >= max_trace_size_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      PutLengthPrefixedSlice(&framed, record);
+      writer_->Write(framed).PermitUncheckedError();
+    }
+    b->tail.store(tail, std::memory_order_release);
+  }
+  PruneRings();
+}
+
+void ZenFSLifecycleTracer::BackgroundWriter() {
+  std::unique_lock<std::mutex> lk(writer_mtx_);
+  while (!stop_) {
+    writer_cv_.wait_for(lk, std::chrono::milliseconds(ZENFS_TRACE_DRAIN_MS));
+    Drain();
+  }
+  Drain();
+}
+
+bool ZenFSLifecycleTracer::NextRecord(Slice *in, Slice *record) {
+  return GetLengthPrefixedSlice(in, record);
+}
+
+bool ZenFSLifecycleTracer::IsHeader(const Slice &record) {
+  return record.starts_with(ZENFS_TRACE_MAGIC);
+}
+
+static void AppendKey(const Slice &key, std::string *out) {
+  out->append(key.empty() ? std::string("-") : key.ToString(true));
+}
+
+bool ZenFSLifecycleTracer::DecodeToText(const Slice &record,
+                                        std::string *line) {
+  Slice in = record;
+  uint64_t ts, fno, arg;
+  uint32_t level;
+  Slice smallest, largest;
+
+  if (IsHeader(in)) return false;
+  if (in.size() < 1) return false;
+  uint8_t type = (uint8_t)in[0];
+  in.remove_prefix(1);
+  if (!GetFixed64(&in, &ts) || !GetVarint64(&in, &fno)) return false;
+
+  line->clear();
+  switch (type) {
+    case ZENFS_TRACE_CREATE:
+      if (!GetVarint32(&in, &level) || in.size() < 1) return false;
+      arg = (uint8_t)in[0];
+      in.remove_prefix(1);
+      if (!GetLengthPrefixedSlice(&in, &smallest) ||
+          !GetLengthPrefixedSlice(&in, &largest))
+        return false;
+      line->append("create " + std::to_string(fno) + " " +
+                   std::to_string((int32_t)level) + " " + std::to_string(arg) +
+                   " ");
+      AppendKey(smallest, line);
+      line->append(" ");
+      AppendKey(largest, line);
+      return true;
+    case ZENFS_TRACE_APPEND:
+      if (!GetVarint64(&in, &arg)) return false;
+      line->append("write " + std::to_string(fno) + " " + std::to_string(arg));
+      return true;
+    case ZENFS_TRACE_CLOSE:
+      line->append("close " + std::to_string(fno));
+      return true;
+    case ZENFS_TRACE_DELETE:
+      line->append("delete " + std::to_string(fno));
+      return true;
+    case ZENFS_TRACE_COMPACTION_INPUT:
+    case ZENFS_TRACE_COMPACTION_OUTPUT:
+      if (!GetVarint64(&in, &arg)) return false;
+      line->append(type == ZENFS_TRACE_COMPACTION_INPUT
+                       ? "# compaction-input "
+                       : "# compaction-output ");
+      line->append(std::to_string(arg) + " " + std::to_string(fno));
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
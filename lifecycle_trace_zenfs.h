@@ -0,0 +1,126 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rocksdb/env.h"
+#include "rocksdb/options.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+#include "rocksdb/trace_reader_writer.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+enum ZenFSTraceEventType : uint8_t {
+  ZENFS_TRACE_CREATE = 1,
+  ZENFS_TRACE_APPEND,
+  ZENFS_TRACE_CLOSE,
+  ZENFS_TRACE_DELETE,
+  ZENFS_TRACE_COMPACTION_INPUT,
+  ZENFS_TRACE_COMPACTION_OUTPUT,
+};
+
+#define ZENFS_TRACE_KEY_LEN (24)
+
+/* Fixed size so the per thread rings never allocate */
+struct ZenFSTraceEvent {
+  uint64_t ts;
+  uint64_t fno;
+  uint64_t arg; /* append bytes or compaction job id */
+  int32_t level;
+  uint8_t type;
+  uint8_t lifetime;
+  uint8_t smallest_len;
+  uint8_t largest_len;
+  char smallest[ZENFS_TRACE_KEY_LEN];
+  char largest[ZENFS_TRACE_KEY_LEN];
+};
+
+/* Single producer ring of one thread, defined in lifecycle_trace_zenfs.cc */
+struct ZenFSTraceRing;
+
+/* Records SST lifecycle events for offline placement studies. The DB
+ * reports every table a flush or compaction installs as created, appended
+ * to with its size and closed, then its deletion and which compaction
+ * linked it to others.
+ *
+ * Producers push fixed size events into a single producer ring owned by
+ * their thread, a background thread drains all rings and encodes them to
+ * the trace writer. Every record, the header included, is written as a
+ * length prefixed slice so the trace can be split with NextRecord() no
+ * matter which TraceWriter produced the file. A full ring drops the event
+ * instead of blocking, drops are counted. The ring of a thread that exited
+ * is freed once it has been drained. Nothing is recorded unless a trace is
+ * started, the disabled path is a single relaxed load.
+ */
+class ZenFSLifecycleTracer {
+ public:
+  ZenFSLifecycleTracer();
+  ~ZenFSLifecycleTracer();
+
+  Status Start(Env *env, const TraceOptions &options,
+               std::unique_ptr<TraceWriter> &&writer);
+  Status End();
+
+  bool IsTracing() const { return tracing_.load(std::memory_order_relaxed); }
+  uint64_t GetDropped() const { return dropped_.load(); }
+
+  void RecordCreate(uint64_t fno, int level, Env::WriteLifeTimeHint lifetime,
+                    const Slice &smallest, const Slice &largest);
+  void RecordAppend(uint64_t fno, uint64_t bytes);
+  void RecordClose(uint64_t fno);
+  void RecordDelete(uint64_t fno);
+  void RecordCompaction(uint64_t job_id, const std::vector<uint64_t> &inputs,
+                        const std::vector<uint64_t> &outputs);
+
+  /* Take the next record off a raw trace, false at the end or on a
+   * truncated record */
+  static bool NextRecord(Slice *in, Slice *record);
+
+  /* True if record is the header a trace starts with */
+  static bool IsHeader(const Slice &record);
+
+  /* One trace record as a zenfs_sim trace line, without the newline. Keys
+   * are printed in hex, "-" when empty. Returns false for the header and
+   * for records it doesn't know. */
+  static bool DecodeToText(const Slice &record, std::string *line);
+
+ private:
+  ZenFSTraceRing *GetThreadRing();
+  void Push(ZenFSTraceEvent *ev);
+  void BackgroundWriter();
+  void Drain();
+  void PruneRings();
+
+  const uint64_t id_;
+  std::atomic<bool> tracing_;
+  std::atomic<uint64_t> dropped_;
+  Env *env_;
+
+  std::mutex rings_mtx_;
+  std::vector<std::shared_ptr<ZenFSTraceRing>> rings_;
+
+  std::mutex writer_mtx_;
+  std::condition_variable writer_cv_;
+  std::thread writer_thread_;
+  std::unique_ptr<TraceWriter> writer_;
+  uint64_t max_trace_size_;
+  bool stop_;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,147 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "metrics_zenfs.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <utility>
+
+namespace ROCKSDB_NAMESPACE {
+
+static const char *alloc_path_names[ZENFS_ALLOC_PATH_NUM] = {
+    "no-sst-empty", "overlap", "l0-majority", "empty",
+    "same-level",   "lifetime", "after-gc",   "none"};
+
+const char *ZenFSAllocPathName(uint32_t path) {
+  if (path >= ZENFS_ALLOC_PATH_NUM) return "unknown";
+  return alloc_path_names[path];
+}
+
+static const char *write_source_names[ZENFS_WR_SOURCE_NUM] = {
+    "wal", "flush", "compaction", "meta", "gc"};
+
+const char *ZenFSWriteSourceName(uint32_t source) {
+  if (source >= ZENFS_WR_SOURCE_NUM) return "unknown";
+  return write_source_names[source];
+}
+
+ZenFSMetrics::ZenFSMetrics() {
+  gc_bytes_copied.store(0);
+  gc_runs.store(0);
+  resets.store(0);
+  finishes.store(0);
+  alloc_waits.store(0);
+  alloc_wait_micros.store(0);
+  for (uint32_t i = 0; i < ZENFS_ALLOC_PATH_NUM; i++) {
+    alloc_path[i].store(0);
+    alloc_path_micros[i].store(0);
+  }
+  last_alloc_path.store(ZENFS_ALLOC_NONE);
+  inline_gc_runs.store(0);
+  inline_gc_micros.store(0);
+  gc_throttled_micros.store(0);
+  gc_bytes_reclaimed.store(0);
+  gc_zones_kept.store(0);
+  gc_hot_victims.store(0);
+  reloc_cache_hits.store(0);
+  reloc_cache_hit_bytes.store(0);
+  drain_zones.store(0);
+  drain_files.store(0);
+  purge_batches.store(0);
+  purge_resets.store(0);
+  for (uint32_t i = 0; i < ZENFS_WR_SOURCE_NUM; i++) write_bytes[i].store(0);
+  for (uint32_t i = 0; i < ZENFS_MAX_LEVELS; i++) {
+    level_host_bytes[i].store(0);
+    level_gc_bytes[i].store(0);
+  }
+}
+
+void ZenFSMetrics::GetCounters(std::map<std::string, uint64_t> *counters) {
+  (*counters)["gc-bytes-copied"] = gc_bytes_copied.load();
+  (*counters)["gc-runs"] = gc_runs.load();
+  (*counters)["resets"] = resets.load();
+  (*counters)["finishes"] = finishes.load();
+  (*counters)["alloc-waits"] = alloc_waits.load();
+  (*counters)["alloc-wait-micros"] = alloc_wait_micros.load();
+  (*counters)["inline-gc-runs"] = inline_gc_runs.load();
+  (*counters)["inline-gc-micros"] = inline_gc_micros.load();
+  (*counters)["gc-throttled-micros"] = gc_throttled_micros.load();
+  (*counters)["gc-bytes-reclaimed"] = gc_bytes_reclaimed.load();
+  (*counters)["gc-zones-kept"] = gc_zones_kept.load();
+  (*counters)["gc-hot-victims"] = gc_hot_victims.load();
+  (*counters)["reloc-cache-hits"] = reloc_cache_hits.load();
+  (*counters)["reloc-cache-hit-bytes"] = reloc_cache_hit_bytes.load();
+  (*counters)["drain-zones"] = drain_zones.load();
+  (*counters)["drain-files"] = drain_files.load();
+  (*counters)["purge-batches"] = purge_batches.load();
+  (*counters)["purge-resets"] = purge_resets.load();
+  for (uint32_t i = 0; i < ZENFS_ALLOC_PATH_NUM; i++) {
+    std::string name = std::string("alloc-path.") + ZenFSAllocPathName(i);
+    (*counters)[name] = alloc_path[i].load();
+    (*counters)[name + ".micros"] = alloc_path_micros[i].load();
+  }
+  for (uint32_t i = 0; i < ZENFS_WR_SOURCE_NUM; i++) {
+    (*counters)[std::string("write-bytes.") + ZenFSWriteSourceName(i)] =
+        write_bytes[i].load();
+  }
+  for (uint32_t i = 0; i < ZENFS_MAX_LEVELS; i++) {
+    std::string lvl = "L" + std::to_string(i);
+    (*counters)["write-bytes." + lvl] = level_host_bytes[i].load();
+    (*counters)["gc-bytes." + lvl] = level_gc_bytes[i].load();
+  }
+}
+
+void ZenFSMetrics::WriteAmpToString(std::string *out) {
+  char buf[128];
+  uint64_t host = write_bytes[ZENFS_WR_WAL].load() +
+                  write_bytes[ZENFS_WR_FLUSH].load() +
+                  write_bytes[ZENFS_WR_COMPACTION].load();
+  uint64_t device = host + write_bytes[ZENFS_WR_META].load() +
+                    write_bytes[ZENFS_WR_GC].load();
+
+  snprintf(buf, sizeof(buf), "overall %.3f (host %" PRIu64 " device %" PRIu64 ")\n",
+           host ? (double)device / host : 0.0, host, device);
+  out->append(buf);
+  for (uint32_t i = 0; i < ZENFS_MAX_LEVELS; i++) {
+    uint64_t h = level_host_bytes[i].load();
+    uint64_t g = level_gc_bytes[i].load();
+    if (h == 0 && g == 0) continue;
+    snprintf(buf, sizeof(buf), "L%u %.3f (host %" PRIu64 " gc %" PRIu64 ")\n", i,
+             h ? (double)(h + g) / h : 0.0, h, g);
+    out->append(buf);
+  }
+}
+
+void ZenFSMetrics::HistogramsToString(std::string *out) {
+  char buf[256];
+
+  out->append("** ZenFS allocation (micros) **\n");
+  for (uint32_t i = 0; i < ZENFS_ALLOC_PATH_NUM; i++) {
+    HistogramData d;
+    alloc_latency[i].Data(&d);
+    snprintf(buf, sizeof(buf),
+             "alloc-path.%-12s count %10" PRIu64 " P50 %10.2f P99 %10.2f "
+             "MAX %10.2f\n",
+             ZenFSAllocPathName(i), d.count, d.median, d.percentile99, d.max);
+    out->append(buf);
+  }
+  for (auto h : {std::make_pair("alloc-wait", &alloc_wait_latency),
+                 std::make_pair("inline-gc", &inline_gc_latency)}) {
+    HistogramData d;
+    h.second->Data(&d);
+    snprintf(buf, sizeof(buf),
+             "%-23s count %10" PRIu64 " P50 %10.2f P99 %10.2f MAX %10.2f\n",
+             h.first, d.count, d.median, d.percentile99, d.max);
+    out->append(buf);
+  }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,144 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <atomic>
+#include <map>
+#include <string>
+
+#include "gc_options_zenfs.h"
+#include "monitoring/histogram.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/* Exits of ZonedBlockDevice::AllocateZone, in the order they are tried */
+enum ZenFSAllocPath : uint32_t {
+  ZENFS_ALLOC_NO_SST_EMPTY = 0, /* no SST placed yet, first empty zone */
+  ZENFS_ALLOC_OVERLAP,          /* zone of an overlapping SST */
+  ZENFS_ALLOC_L0_MAJORITY,      /* zone holding most L0 data */
+  ZENFS_ALLOC_EMPTY,            /* empty zone */
+  ZENFS_ALLOC_SAME_LEVEL,       /* zone of a key-adjacent same level SST */
+  ZENFS_ALLOC_LIFETIME,         /* open zone with the best lifetime diff */
+  ZENFS_ALLOC_AFTER_GC,         /* any of the above after inline GC */
+  ZENFS_ALLOC_NONE,             /* nothing found */
+  ZENFS_ALLOC_PATH_NUM
+};
+
+const char *ZenFSAllocPathName(uint32_t path);
+
+/* Who a zone append is written for */
+enum ZenFSWriteSource : uint32_t {
+  ZENFS_WR_WAL = 0,    /* WAL and other non-SST files */
+  ZENFS_WR_FLUSH,      /* L0 SSTs */
+  ZENFS_WR_COMPACTION, /* L1+ SSTs */
+  ZENFS_WR_META,       /* metadata log */
+  ZENFS_WR_GC,         /* ZoneCleaning relocation */
+  ZENFS_WR_SOURCE_NUM
+};
+
+/* Per level accounting covers L0..L7 */
+#define ZENFS_MAX_LEVELS (8)
+
+const char *ZenFSWriteSourceName(uint32_t source);
+
+/* AllocateZone is called with level 100 for files that are not SSTs */
+inline ZenFSWriteSource ZenFSWriteSourceForLevel(int level) {
+  if (level == 0) return ZENFS_WR_FLUSH;
+  if (level > 0 && level < 100) return ZENFS_WR_COMPACTION;
+  return ZENFS_WR_WAL;
+}
+
+/* Device wide counters. Everything is a relaxed atomic bumped on the I/O
+ * path, so reading them never needs io_zones_mtx or a zone scan. */
+struct ZenFSMetrics {
+  ZenFSMetrics();
+
+  void RecordAllocPath(ZenFSAllocPath path, uint64_t micros) {
+    alloc_path[path].fetch_add(1, std::memory_order_relaxed);
+    alloc_path_micros[path].fetch_add(micros, std::memory_order_relaxed);
+    alloc_latency[path].Add(micros);
+    last_alloc_path.store(path, std::memory_order_relaxed);
+  }
+
+  void RecordAllocWait(uint64_t micros) {
+    alloc_waits.fetch_add(1, std::memory_order_relaxed);
+    alloc_wait_micros.fetch_add(micros, std::memory_order_relaxed);
+    alloc_wait_latency.Add(micros);
+  }
+
+  /* GC writes are charged to the level of the file owning the extent */
+  void RecordWrite(ZenFSWriteSource source, int level, uint64_t bytes) {
+    write_bytes[source].fetch_add(bytes, std::memory_order_relaxed);
+    if (level < 0 || level >= ZENFS_MAX_LEVELS) return;
+    if (source == ZENFS_WR_GC)
+      level_gc_bytes[level].fetch_add(bytes, std::memory_order_relaxed);
+    else
+      level_host_bytes[level].fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /* Device bytes written per host byte, overall and per level */
+  void WriteAmpToString(std::string *out);
+
+  void RecordInlineGC(uint64_t micros) {
+    inline_gc_runs.fetch_add(1, std::memory_order_relaxed);
+    inline_gc_micros.fetch_add(micros, std::memory_order_relaxed);
+    inline_gc_latency.Add(micros);
+  }
+
+  /* name -> value of every counter, names as in rocksdb.zenfs.<name>.
+   * Only monotonic values, so stats history can store deltas. */
+  void GetCounters(std::map<std::string, uint64_t> *counters);
+
+  /* Histogram summary of the allocation paths, for DumpStats */
+  void HistogramsToString(std::string *out);
+
+  std::atomic<uint64_t> gc_bytes_copied;
+  std::atomic<uint64_t> gc_runs;
+  std::atomic<uint64_t> resets;
+  std::atomic<uint64_t> finishes;
+  std::atomic<uint64_t> alloc_waits;
+  std::atomic<uint64_t> alloc_wait_micros;
+  std::atomic<uint64_t> alloc_path[ZENFS_ALLOC_PATH_NUM];
+  std::atomic<uint64_t> alloc_path_micros[ZENFS_ALLOC_PATH_NUM];
+  std::atomic<uint32_t> last_alloc_path;
+  std::atomic<uint64_t> inline_gc_runs;
+  std::atomic<uint64_t> inline_gc_micros;
+  std::atomic<uint64_t> gc_throttled_micros;
+  std::atomic<uint64_t> gc_bytes_reclaimed;
+  std::atomic<uint64_t> gc_zones_kept;
+  std::atomic<uint64_t> gc_hot_victims;
+  std::atomic<uint64_t> reloc_cache_hits;
+  std::atomic<uint64_t> reloc_cache_hit_bytes;
+  std::atomic<uint64_t> drain_zones;
+  std::atomic<uint64_t> drain_files;
+  std::atomic<uint64_t> purge_batches;
+  std::atomic<uint64_t> purge_resets;
+  std::atomic<uint64_t> write_bytes[ZENFS_WR_SOURCE_NUM];
+  std::atomic<uint64_t> level_host_bytes[ZENFS_MAX_LEVELS];
+  std::atomic<uint64_t> level_gc_bytes[ZENFS_MAX_LEVELS];
+
+  HistogramImpl alloc_latency[ZENFS_ALLOC_PATH_NUM];
+  HistogramImpl alloc_wait_latency;
+  HistogramImpl inline_gc_latency;
+};
+
+/* Counters of one zone as the zone-stats property reports them */
+struct ZoneStatsSnapshot {
+  uint32_t zone_id;
+  uint64_t written;
+  uint64_t valid;
+  uint64_t capacity;
+  uint64_t max_capacity;
+  bool open;
+  uint64_t region_invalid[ZENFS_ZONE_REGIONS];
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,347 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "multiread_zenfs.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#if defined(ROCKSDB_IOURING_PRESENT)
+#include <liburing.h>
+#include <sys/uio.h>
+#endif
+
+#include "buffer_pool_zenfs.h"
+#include "io_zenfs.h"
+#include "relocation_cache_zenfs.h"
+#include "zbd_backend.h"
+#include "zbd_zenfs.h"
+#include "zone_io_zenfs.h"
+
+/* Queue depth of the per thread ring used for batched reads */
+#define ZENFS_MULTIREAD_QD (256)
+
+namespace ROCKSDB_NAMESPACE {
+
+namespace {
+
+#if defined(ROCKSDB_IOURING_PRESENT)
+struct ThreadRing {
+  ThreadRing() : ok(false), disabled(false) {}
+  ~ThreadRing() { Reset(); }
+  /* Set up on first use, a kernel without io_uring is asked only once */
+  bool Ready() {
+    if (!ok && !disabled) {
+      ok = (io_uring_queue_init(ZENFS_MULTIREAD_QD, &ring, 0) == 0);
+      disabled = !ok;
+    }
+    return ok;
+  }
+  /* Drop a ring left in an unknown state, the next Ready() makes a new one */
+  void Reset() {
+    if (ok) io_uring_queue_exit(&ring);
+    ok = false;
+  }
+  struct io_uring ring;
+  bool ok;
+  bool disabled;
+};
+
+thread_local ThreadRing zenfs_read_ring;
+#endif
+
+IOStatus PreadPiece(int fd, ZonedDeviceRead *p) {
+  while (p->done < p->length) {
+    ssize_t r = pread(fd, p->dst + p->done, p->length - p->done,
+                      p->dev_offset + p->done);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return IOStatus::IOError("MultiRead pread failed");
+    }
+    if (r == 0) break;
+    p->done += r;
+  }
+  return IOStatus::OK();
+}
+
+#if defined(ROCKSDB_IOURING_PRESENT)
+/* Submit the pieces in rounds of at most the ring depth. Every read that
+ * was submitted is reaped before anything else touches its buffer, so a
+ * pread fallback never races with the kernel. If the ring misbehaves it is
+ * torn down and the pieces not submitted yet are read with pread. Short
+ * reads are finished with pread too, that only happens at the end of the
+ * device. Returns false if no ring is available, nothing was read then. */
+bool UringReadPieces(int fd, std::vector<ZonedDeviceRead> &pieces) {
+  if (!zenfs_read_ring.Ready()) return false;
+
+  struct io_uring *ring = &zenfs_read_ring.ring;
+  std::vector<struct iovec> iov(ZENFS_MULTIREAD_QD);
+  size_t next = 0;
+
+  while (next < pieces.size()) {
+    size_t batch = 0;
+
+    while (next + batch < pieces.size() && batch < ZENFS_MULTIREAD_QD) {
+      ZonedDeviceRead &p = pieces[next + batch];
+      struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+      if (!sqe) break;
+      iov[batch].iov_base = p.dst;
+      iov[batch].iov_len = p.length;
+      io_uring_prep_readv(sqe, fd, &iov[batch], 1, p.dev_offset);
+      io_uring_sqe_set_data(sqe, (void *)(next + batch));
+      batch++;
+    }
+
+    /* No free SQE with nothing of ours queued means a broken ring */
+    int ret = batch ? io_uring_submit(ring) : -EBUSY;
+    size_t submitted = ret > 0 ? (size_t)ret : 0;
+    std::vector<bool> reaped(submitted, false);
+
+    for (size_t i = 0; i < submitted; i++) {
+      struct io_uring_cqe *cqe;
+      do {
+        ret = io_uring_wait_cqe(ring, &cqe);
+      } while (ret == -EINTR || ret == -EAGAIN);
+      if (ret < 0) {
+        /* Completions are lost, the reads still in flight may land any
+         * time. Fail them instead of handing their buffers to pread. */
+        for (size_t k = 0; k < submitted; k++) {
+          if (reaped[k]) continue;
+          pieces[next + k].done = 0;
+          pieces[next + k].status =
+              IOStatus::IOError("MultiRead io_uring completion lost");
+        }
+        batch = 0;
+        break;
+      }
+      size_t idx = (size_t)io_uring_cqe_get_data(cqe);
+      ZonedDeviceRead &p = pieces[idx];
+      if (cqe->res < 0) {
+        p.status = IOStatus::IOError("MultiRead io_uring read failed");
+      } else {
+        p.done = cqe->res;
+        if (p.done < p.length && cqe->res > 0) p.status = PreadPiece(fd, &p);
+      }
+      reaped[idx - next] = true;
+      io_uring_cqe_seen(ring, cqe);
+    }
+    next += submitted;
+
+    /* Unsubmitted SQEs go away with the ring */
+    if (submitted < batch || batch == 0) {
+      zenfs_read_ring.Reset();
+      break;
+    }
+  }
+
+  for (; next < pieces.size(); next++) {
+    pieces[next].done = 0;
+    pieces[next].status = PreadPiece(fd, &pieces[next]);
+  }
+  return true;
+}
+#endif
+
+}  // namespace
+
+IOStatus ZonedReadDevice(ZonedBlockDevice *zbd,
+                         std::vector<ZonedDeviceRead> *reads) {
+  std::vector<ZonedDeviceRead> &pieces = *reads;
+  int fd = zbd->GetReadFD();
+
+  /* O_DIRECT needs block aligned offsets, lengths and buffers. Pieces that
+   * are not are widened to whole blocks inside one shared bounce buffer,
+   * the batch goes to the device as is and they are copied out afterwards.
+   * The bounce buffer comes from the device's read buffer pool, only
+   * batches larger than a pooled buffer get an allocation of their own. */
+  bool direct = zbd->UseDirectReads();
+  if (direct) fd = zbd->GetBackend()->GetReadDirectFD();
+  std::vector<ZonedDeviceRead> dev = pieces;
+  std::vector<size_t> skip(pieces.size(), 0);
+  std::vector<bool> bounced(pieces.size(), false);
+  AlignedBufferPool *buffers = zbd->GetReadBuffers();
+  char *bounce = nullptr;
+  size_t bounce_sz = 0;
+  if (direct && fd >= 0) {
+    uint32_t block_sz = zbd->GetBlockSize();
+    size_t total = 0;
+    for (size_t p = 0; p < pieces.size(); p++) {
+      uint64_t off = pieces[p].dev_offset;
+      if (off % block_sz == 0 && pieces[p].length % block_sz == 0 &&
+          (uintptr_t)pieces[p].dst % block_sz == 0)
+        continue;
+      bounced[p] = true;
+      skip[p] = off % block_sz;
+      size_t len = skip[p] + pieces[p].length;
+      if (len % block_sz) len += block_sz - (len % block_sz);
+      dev[p].dev_offset = off - skip[p];
+      dev[p].length = len;
+      total += len;
+    }
+    if (total) {
+      bounce = buffers->Get(total);
+      if (!bounce)
+        return IOStatus::IOError("MultiRead bounce buffer allocation failed");
+      bounce_sz = total;
+    }
+    total = 0;
+    for (size_t p = 0; p < dev.size(); p++) {
+      if (!bounced[p]) continue;
+      dev[p].dst = bounce + total;
+      total += dev[p].length;
+    }
+  }
+  for (auto &d : dev) {
+    d.done = 0;
+    d.status = IOStatus::OK();
+  }
+
+  bool submitted = false;
+  if (fd < 0) {
+    /* Backends without a file descriptor (the simulator) */
+    for (size_t p = 0; p < dev.size(); p++) {
+      ssize_t r = zbd->ReadData(dev[p].dev_offset, dev[p].length, dev[p].dst);
+      if (r < 0) {
+        dev[p].status = IOStatus::IOError("MultiRead device read failed");
+      } else {
+        dev[p].done = r;
+      }
+    }
+    submitted = true;
+  }
+#if defined(ROCKSDB_IOURING_PRESENT)
+  /* Without a ring nothing is timed here, the pread loop below does it */
+  if (!submitted && zenfs_read_ring.Ready()) {
+    /* All pieces are in flight together, each is charged the batch time.
+     * Pieces UringReadPieces() falls back to pread for stay in it. */
+    std::vector<std::unique_ptr<ZenFSZoneIO::Scope>> io;
+    for (const auto &p : dev)
+      io.emplace_back(new ZenFSZoneIO::Scope(zbd->GetZoneIO(), p.dev_offset,
+                                             ZENFS_ZOP_READ, p.length));
+    submitted = UringReadPieces(fd, dev);
+  }
+#endif
+  if (!submitted) {
+    for (size_t p = 0; p < dev.size(); p++) {
+      ZenFSZoneIO::Scope io(zbd->GetZoneIO(), dev[p].dev_offset,
+                            ZENFS_ZOP_READ, dev[p].length);
+      dev[p].status = PreadPiece(fd, &dev[p]);
+    }
+  }
+
+  for (size_t p = 0; p < pieces.size(); p++) {
+    pieces[p].status = dev[p].status;
+    if (!bounced[p]) {
+      pieces[p].done = dev[p].done;
+      continue;
+    }
+    size_t got = dev[p].done > skip[p] ? dev[p].done - skip[p] : 0;
+    got = std::min(got, pieces[p].length);
+    memcpy(pieces[p].dst, dev[p].dst + skip[p], got);
+    pieces[p].done = got;
+  }
+  buffers->Put(bounce, bounce_sz);
+  return IOStatus::OK();
+}
+
+IOStatus ZonedMultiRead(ZonedBlockDevice *zbd, ZoneFile *zone_file,
+                        FSReadRequest *reqs, size_t num_reqs) {
+  std::vector<ZonedDeviceRead> all_pieces;
+  std::vector<size_t> piece_req;
+  RelocationCache *reloc_cache = zbd->GetRelocationCache();
+
+  /* Map every request onto the extents while they can't move */
+  zone_file->ExtentReadLock();
+  std::vector<ZoneExtent *> extents = zone_file->GetExtentsList();
+  for (size_t i = 0; i < num_reqs; i++) {
+    FSReadRequest &req = reqs[i];
+    uint64_t file_off = 0;
+    uint64_t want_start = req.offset;
+    uint64_t want_end = req.offset + req.len;
+
+    for (const auto ext : extents) {
+      uint64_t ext_end = file_off + ext->length_;
+      if (ext_end > want_start && file_off < want_end) {
+        uint64_t from = std::max(want_start, file_off);
+        uint64_t to = std::min(want_end, ext_end);
+        ZonedDeviceRead piece = {ext->start_ + (from - file_off),
+                                 (size_t)(to - from),
+                                 req.scratch + (from - want_start), 0,
+                                 IOStatus::OK()};
+        /* Extents GC is relocating are served from its copy */
+        if (reloc_cache->Read(ext, from - file_off, piece.length, piece.dst))
+          piece.done = piece.length;
+        all_pieces.push_back(piece);
+        piece_req.push_back(i);
+      }
+      file_off = ext_end;
+      if (file_off >= want_end) break;
+    }
+  }
+
+  /* Only the pieces that were not cached go to the device */
+  std::vector<ZonedDeviceRead> pieces;
+  std::vector<size_t> piece_idx;
+  for (size_t p = 0; p < all_pieces.size(); p++) {
+    if (all_pieces[p].done == all_pieces[p].length) continue;
+    pieces.push_back(all_pieces[p]);
+    piece_idx.push_back(p);
+  }
+  IOStatus s;
+  if (!pieces.empty()) s = ZonedReadDevice(zbd, &pieces);
+  zone_file->ExtentReadUnlock();
+  if (!s.ok()) return s;
+
+  for (size_t p = 0; p < pieces.size(); p++)
+    all_pieces[piece_idx[p]] = pieces[p];
+
+  /* Pieces of a request are in file order, the result ends at the first
+   * short piece just like a short pread */
+  std::vector<bool> short_read(num_reqs, false);
+  std::vector<uint64_t> got(num_reqs, 0);
+  for (size_t i = 0; i < num_reqs; i++) reqs[i].status = IOStatus::OK();
+  for (size_t p = 0; p < all_pieces.size(); p++) {
+    const ZonedDeviceRead &piece = all_pieces[p];
+    FSReadRequest &req = reqs[piece_req[p]];
+    if (!piece.status.ok()) req.status = piece.status;
+    if (short_read[piece_req[p]]) continue;
+    got[piece_req[p]] += piece.done;
+    if (piece.done < piece.length) short_read[piece_req[p]] = true;
+  }
+  for (size_t i = 0; i < num_reqs; i++) {
+    reqs[i].result = Slice(reqs[i].scratch, got[i]);
+  }
+
+  return IOStatus::OK();
+}
+
+IOStatus ZonedPositionedRead(ZonedBlockDevice *zbd, ZoneFile *zone_file,
+                             uint64_t offset, size_t n, Slice *result,
+                             char *scratch) {
+  FSReadRequest req;
+  req.offset = offset;
+  req.len = n;
+  req.scratch = scratch;
+  IOStatus s = ZonedMultiRead(zbd, zone_file, &req, 1);
+  if (!s.ok()) {
+    *result = Slice(scratch, 0);
+    return s;
+  }
+  *result = req.result;
+  return req.status;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,59 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <vector>
+
+#include "rocksdb/file_system.h"
+#include "rocksdb/io_status.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+class ZonedBlockDevice;
+class ZoneFile;
+
+/* One range of a device batch read */
+struct ZonedDeviceRead {
+  uint64_t dev_offset;
+  size_t length;
+  char *dst;
+  size_t done; /* bytes read */
+  IOStatus status;
+};
+
+/* Read all ranges together, through io_uring when RocksDB was built with
+ * it. Direct mode is honoured, ranges whose offset, length and buffer are
+ * block aligned are read in place, the others bounce through a pooled
+ * buffer. Reads are accounted per zone. Extents are not locked, callers
+ * map and pin them. Non-ok only when no bounce buffer was available. */
+IOStatus ZonedReadDevice(ZonedBlockDevice *zbd,
+                         std::vector<ZonedDeviceRead> *reads);
+
+/* Batched positional reads of a zone file.
+ *
+ * Each request is mapped onto the file's extents and split where it crosses
+ * an extent boundary. All pieces are then submitted together through
+ * io_uring when RocksDB was built with it, so a MultiGet batch costs about
+ * one device round trip. Without io_uring the pieces fall back to pread.
+ * Per request status and result are set like FSRandomAccessFile::MultiRead.
+ */
+IOStatus ZonedMultiRead(ZonedBlockDevice *zbd, ZoneFile *zone_file,
+                        FSReadRequest *reqs, size_t num_reqs);
+
+/* A single positional read of a zone file, what ZoneFile::PositionedRead()
+ * does, on the same path as a batch: extents are mapped and read under the
+ * extent read lock, direct mode is honoured and the read is accounted per
+ * zone. */
+IOStatus ZonedPositionedRead(ZonedBlockDevice *zbd, ZoneFile *zone_file,
+                             uint64_t offset, size_t n, Slice *result,
+                             char *scratch);
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
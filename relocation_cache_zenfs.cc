@@ -0,0 +1,60 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "relocation_cache_zenfs.h"
+
+#include <string.h>
+
+#include "metrics_zenfs.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+RelocationCache::RelocationCache(ZenFSMetrics *metrics, uint64_t max_bytes)
+    : metrics_(metrics), max_bytes_(max_bytes), bytes_(0) {}
+
+void RelocationCache::Insert(const ZoneExtent *extent, const char *data,
+                             size_t len) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (bytes_ + len > max_bytes_ || extents_.count(extent)) return;
+    bytes_ += len;
+  }
+  /* Copy outside the lock, readers only see the entry once it is complete */
+  std::shared_ptr<const std::string> buf =
+      std::make_shared<const std::string>(data, len);
+  std::lock_guard<std::mutex> lock(mtx_);
+  extents_[extent] = buf;
+}
+
+bool RelocationCache::Read(const ZoneExtent *extent, uint64_t off, size_t n,
+                           char *dst) {
+  std::shared_ptr<const std::string> buf;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = extents_.find(extent);
+    if (it == extents_.end()) return false;
+    buf = it->second;
+  }
+  if (off + n > buf->size()) return false;
+  memcpy(dst, buf->data() + off, n);
+  metrics_->reloc_cache_hits++;
+  metrics_->reloc_cache_hit_bytes += n;
+  return true;
+}
+
+void RelocationCache::Drop(const ZoneExtent *extent) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = extents_.find(extent);
+  if (it == extents_.end()) return;
+  bytes_ -= it->second->size();
+  extents_.erase(it);
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
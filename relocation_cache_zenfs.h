@@ -0,0 +1,67 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/* Upper bound on extent data held for in-flight relocations */
+#define ZENFS_RELOC_CACHE_BYTES (64 * 1024 * 1024)
+
+namespace ROCKSDB_NAMESPACE {
+
+class ZoneExtent;
+class ZenFSMetrics;
+
+/* Data of extents that GC is relocating.
+ *
+ * ZoneCleaning reads every valid extent of the victim before it copies it
+ * out. That data is kept here, keyed by the source extent, until the file's
+ * extent list has been swapped to the new copies. Readers that still map
+ * onto the source extent in that window are served from memory instead of
+ * adding reads to a zone that GC is already streaming from.
+ *
+ * Entries are never stale: extent data is immutable and an extent is
+ * dropped before its ZoneExtent can be freed. Inserts beyond the byte limit
+ * are refused, GC itself never depends on the cache.
+ */
+class RelocationCache {
+ public:
+  explicit RelocationCache(ZenFSMetrics *metrics,
+                           uint64_t max_bytes = ZENFS_RELOC_CACHE_BYTES);
+
+  /* Keep a copy of the first len bytes of data for extent */
+  void Insert(const ZoneExtent *extent, const char *data, size_t len);
+  /* Copy n bytes at off (relative to the extent start) into dst, false if
+   * the extent is not cached */
+  bool Read(const ZoneExtent *extent, uint64_t off, size_t n, char *dst);
+  void Drop(const ZoneExtent *extent);
+
+  uint64_t Bytes() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return bytes_;
+  }
+
+ private:
+  ZenFSMetrics *metrics_;
+  uint64_t max_bytes_;
+  std::mutex mtx_;
+  uint64_t bytes_;
+  std::unordered_map<const ZoneExtent *, std::shared_ptr<const std::string>>
+      extents_;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
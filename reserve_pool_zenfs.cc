@@ -0,0 +1,151 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "reserve_pool_zenfs.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "zbd_zenfs.h"
+
+/* Floor of the free list unless configured otherwise */
+#define ZENFS_RESERVE_MIN (2)
+
+/* Weight of the last pass in the smoothed demand */
+#define ZENFS_RESERVE_DEMAND_ALPHA (0.3)
+
+namespace ROCKSDB_NAMESPACE {
+
+ZoneReservePool::ZoneReservePool()
+    : initial_(0),
+      min_(ZENFS_RESERVE_MIN),
+      max_(0),
+      target_(0),
+      acquired_in_pass_(0),
+      demand_(0) {
+  Publish();
+}
+
+void ZoneReservePool::Init(const std::vector<Zone *> &zones,
+                           std::vector<Zone *> *rejected) {
+  for (const auto z : zones) {
+    if (z->IsEmpty() && !z->IsUsed())
+      free_.push_back(z);
+    else
+      rejected->push_back(z);
+  }
+  initial_ = zones.size();
+  max_ = std::max(max_, initial_);
+  target_ = free_.size();
+  demand_ = (double)target_ / 1.5;
+  CheckInvariants();
+  Publish();
+}
+
+void ZoneReservePool::SetLimits(size_t min, size_t max, size_t nr_io_zones) {
+  if (min) min_ = min;
+  max_ = max ? max : std::max(initial_, nr_io_zones / 64);
+  max_ = std::max(max_, min_);
+  target_ = std::min(std::max(target_, min_), max_);
+  Publish();
+}
+
+Zone *ZoneReservePool::Acquire() {
+  if (free_.empty()) return nullptr;
+  Zone *z = free_.back();
+  free_.pop_back();
+  held_.insert(z);
+  acquired_in_pass_++;
+  Publish();
+  return z;
+}
+
+Zone *ZoneReservePool::Lend() {
+  if (free_.empty()) return nullptr;
+  Zone *z = free_.back();
+  free_.pop_back();
+  Publish();
+  return z;
+}
+
+void ZoneReservePool::Adopt(Zone *z) {
+  assert(z->IsEmpty() && !z->open_for_write_);
+  held_.insert(z);
+  acquired_in_pass_++;
+  Publish();
+}
+
+void ZoneReservePool::Retire(Zone *z) {
+  size_t n = held_.erase(z);
+  assert(n == 1);
+  (void)n;
+  Publish();
+}
+
+bool ZoneReservePool::Release(Zone *z) {
+  assert(z->IsEmpty() && !z->IsUsed() && !z->open_for_write_);
+  held_.erase(z);
+  bool kept = free_.size() < target_;
+  if (kept) free_.push_back(z);
+  Publish();
+  return kept;
+}
+
+void ZoneReservePool::EndPass(std::vector<Zone *> *io_zones) {
+  demand_ = ZENFS_RESERVE_DEMAND_ALPHA * acquired_in_pass_ +
+            (1 - ZENFS_RESERVE_DEMAND_ALPHA) * demand_;
+  acquired_in_pass_ = 0;
+  target_ = (size_t)ceil(demand_ * 1.5) + 1;
+  target_ = std::min(std::max(target_, min_), max_);
+
+  /* Top up with empty io zones, starting at the back where zones given
+   * back by earlier passes and lent zones were added */
+  for (size_t i = io_zones->size(); free_.size() < target_ && i > 0; i--) {
+    Zone *z = (*io_zones)[i - 1];
+    if (z->IsEmpty() && !z->IsUsed() && !z->open_for_write_) {
+      free_.push_back(z);
+      io_zones->erase(io_zones->begin() + (i - 1));
+    }
+  }
+
+  while (free_.size() > target_) {
+    io_zones->push_back(free_.back());
+    free_.pop_back();
+  }
+
+  CheckInvariants();
+  Publish();
+}
+
+void ZoneReservePool::GetZones(std::vector<Zone *> *zones) {
+  zones->insert(zones->end(), free_.begin(), free_.end());
+  zones->insert(zones->end(), held_.begin(), held_.end());
+}
+
+void ZoneReservePool::Publish() {
+  free_count_.store(free_.size());
+  held_count_.store(held_.size());
+  target_count_.store(target_);
+}
+
+void ZoneReservePool::CheckInvariants() {
+#ifndef NDEBUG
+  std::unordered_set<Zone *> seen;
+  for (const auto z : free_) {
+    assert(z->IsEmpty() && !z->IsUsed() && !z->open_for_write_);
+    assert(held_.count(z) == 0);
+    assert(seen.insert(z).second);
+  }
+#endif
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,89 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <unordered_set>
+#include <vector>
+
+namespace ROCKSDB_NAMESPACE {
+
+class Zone;
+
+/* Zones set aside as GC destinations.
+ *
+ * Free zones are empty and ready, held zones were acquired by GC and are
+ * being filled. A held zone either comes back with Release() after it was
+ * reset or leaves the pool with Retire() once it is full. Acquire and
+ * release are O(1); the pool is only rebalanced against the io zones once
+ * per cleaning pass.
+ *
+ * The free list is sized by demand: the zones acquired per pass are
+ * averaged and the target keeps 1.5x that plus one spare, clamped to
+ * [min, max]. All calls are made with io_zones_mtx held, except for the
+ * counts, which are published as atomics for the property readers.
+ */
+class ZoneReservePool {
+ public:
+  ZoneReservePool();
+
+  /* Seed with candidate zones, the ones that are not empty (data from
+   * before a remount) are handed back in rejected */
+  void Init(const std::vector<Zone *> &zones, std::vector<Zone *> *rejected);
+
+  /* min 0 keeps the current floor, max 0 means max(initial, nr_io_zones/64) */
+  void SetLimits(size_t min, size_t max, size_t nr_io_zones);
+
+  Zone *Acquire();
+  /* Hand a free zone to file allocation, it leaves the pool for good and
+   * does not count as GC demand */
+  Zone *Lend();
+  /* Take an empty zone from outside (io zones) when the pool ran dry */
+  void Adopt(Zone *z);
+  /* A held zone became full, it now belongs to the io zones */
+  void Retire(Zone *z);
+  /* Offer a reset zone, false if the free list is already at target */
+  bool Release(Zone *z);
+
+  /* Called at the end of a cleaning pass: adapt the target, then top up
+   * from or give back to io_zones */
+  void EndPass(std::vector<Zone *> *io_zones);
+
+  bool IsHeld(Zone *z) { return held_.count(z) > 0; }
+  void GetZones(std::vector<Zone *> *zones);
+
+  size_t FreeCount() { return free_count_.load(); }
+  size_t HeldCount() { return held_count_.load(); }
+  size_t Target() { return target_count_.load(); }
+
+ private:
+  void CheckInvariants();
+  void Publish();
+
+  std::vector<Zone *> free_; /* stack */
+  std::unordered_set<Zone *> held_;
+
+  size_t initial_;
+  size_t min_;
+  size_t max_;
+  size_t target_;
+  uint64_t acquired_in_pass_;
+  double demand_; /* smoothed zones acquired per pass */
+
+  std::atomic<size_t> free_count_;
+  std::atomic<size_t> held_count_;
+  std::atomic<size_t> target_count_;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,308 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "zbd_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace ROCKSDB_NAMESPACE {
+
+LibzbdBackend::LibzbdBackend(const std::string &bdevname)
+    : filename_("/dev/" + bdevname),
+      zone_sz_(0),
+      nr_zones_(0),
+      read_f_(-1),
+      read_direct_f_(-1),
+      write_f_(-1) {}
+
+LibzbdBackend::~LibzbdBackend() {
+  if (read_f_ >= 0) zbd_close(read_f_);
+  if (read_direct_f_ >= 0) zbd_close(read_direct_f_);
+  if (write_f_ >= 0) zbd_close(write_f_);
+}
+
+IOStatus LibzbdBackend::Open(bool readonly, ZbdDeviceInfo *info) {
+  zbd_info zinfo;
+
+  read_f_ = zbd_open(filename_.c_str(), O_RDONLY, &zinfo);
+  if (read_f_ < 0) {
+    return IOStatus::InvalidArgument("Failed to open zoned block device");
+  }
+
+  read_direct_f_ = zbd_open(filename_.c_str(), O_RDONLY | O_DIRECT, &zinfo);
+  if (read_direct_f_ < 0) {
+    return IOStatus::InvalidArgument("Failed to open zoned block device");
+  }
+
+  if (readonly) {
+    write_f_ = -1;
+  } else {
+    write_f_ = zbd_open(filename_.c_str(), O_WRONLY | O_DIRECT, &zinfo);
+    if (write_f_ < 0) {
+      return IOStatus::InvalidArgument("Failed to open zoned block device");
+    }
+  }
+
+  zone_sz_ = zinfo.zone_size;
+  nr_zones_ = zinfo.nr_zones;
+
+  info->nr_zones = zinfo.nr_zones;
+  info->zone_sz = zinfo.zone_size;
+  info->block_sz = zinfo.pblock_size;
+  info->max_nr_active_zones = zinfo.max_nr_active_zones;
+  info->max_nr_open_zones = zinfo.max_nr_open_zones;
+  info->host_managed = (zinfo.model == ZBD_DM_HOST_MANAGED);
+  return IOStatus::OK();
+}
+
+IOStatus LibzbdBackend::ListZones(std::vector<struct zbd_zone> *zones) {
+  struct zbd_zone *zone_rep;
+  unsigned int reported_zones;
+  uint64_t addr_space_sz = (uint64_t)nr_zones_ * zone_sz_;
+
+  int ret = zbd_list_zones(read_f_, 0, addr_space_sz, ZBD_RO_ALL, &zone_rep,
+                           &reported_zones);
+  if (ret || reported_zones != nr_zones_) {
+    return IOStatus::IOError("Failed to list zones");
+  }
+  zones->assign(zone_rep, zone_rep + reported_zones);
+  free(zone_rep);
+  return IOStatus::OK();
+}
+
+IOStatus LibzbdBackend::Reset(uint64_t start, struct zbd_zone *after) {
+  unsigned int report = 1;
+  int ret;
+
+  ret = zbd_reset_zones(write_f_, start, zone_sz_);
+  if (ret) return IOStatus::IOError("Zone reset failed\n");
+
+  ret = zbd_report_zones(write_f_, start, zone_sz_, ZBD_RO_ALL, after, &report);
+  if (ret || (report != 1)) return IOStatus::IOError("Zone report failed\n");
+
+  return IOStatus::OK();
+}
+
+IOStatus LibzbdBackend::Finish(uint64_t start) {
+  if (zbd_finish_zones(write_f_, start, zone_sz_))
+    return IOStatus::IOError("Zone finish failed\n");
+  return IOStatus::OK();
+}
+
+IOStatus LibzbdBackend::Close(uint64_t start) {
+  if (zbd_close_zones(write_f_, start, zone_sz_))
+    return IOStatus::IOError("Zone close failed\n");
+  return IOStatus::OK();
+}
+
+ssize_t LibzbdBackend::Write(const char *data, size_t size, uint64_t pos) {
+  return pwrite(write_f_, data, size, pos);
+}
+
+ssize_t LibzbdBackend::Read(char *buf, size_t size, uint64_t pos,
+                            bool direct) {
+  return pread(direct ? read_direct_f_ : read_f_, buf, size, pos);
+}
+
+SimZbdBackend::SimZbdBackend(uint32_t nr_zones, uint64_t zone_sz,
+                             uint64_t zone_cap, uint32_t block_sz,
+                             uint32_t max_active, uint32_t max_open,
+                             const std::string &image_path, bool keep_data)
+    : nr_zones_(nr_zones),
+      zone_sz_(zone_sz),
+      zone_cap_(std::min(zone_cap, zone_sz)),
+      block_sz_(block_sz),
+      max_active_(max_active),
+      max_open_(max_open),
+      image_path_(image_path),
+      keep_data_(keep_data),
+      image_f_(-1) {}
+
+SimZbdBackend::~SimZbdBackend() {
+  if (image_f_ >= 0) close(image_f_);
+}
+
+std::string SimZbdBackend::GetFilename() {
+  return image_path_.empty() ? std::string("sim:memory") : "sim:" + image_path_;
+}
+
+IOStatus SimZbdBackend::Open(bool /*readonly*/, ZbdDeviceInfo *info) {
+  if (!image_path_.empty()) {
+    image_f_ = open(image_path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (image_f_ < 0)
+      return IOStatus::InvalidArgument("Failed to open simulator image");
+  }
+
+  zones_.clear();
+  for (uint32_t i = 0; i < nr_zones_; i++) {
+    SimZone z;
+    z.start = (uint64_t)i * zone_sz_;
+    z.wp = z.start;
+    z.cond = ZBD_ZONE_COND_EMPTY;
+    zones_.push_back(z);
+  }
+
+  info->nr_zones = nr_zones_;
+  info->zone_sz = zone_sz_;
+  info->block_sz = block_sz_;
+  info->max_nr_active_zones = max_active_;
+  info->max_nr_open_zones = max_open_;
+  info->host_managed = true;
+  return IOStatus::OK();
+}
+
+IOStatus SimZbdBackend::ListZones(std::vector<struct zbd_zone> *zones) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  zones->clear();
+  for (const auto &sz : zones_) {
+    struct zbd_zone z;
+    memset(&z, 0, sizeof(z));
+    z.start = sz.start;
+    z.len = zone_sz_;
+    z.capacity = zone_cap_;
+    z.wp = sz.wp;
+    z.type = ZBD_ZONE_TYPE_SWR;
+    z.cond = sz.cond;
+    zones->push_back(z);
+  }
+  return IOStatus::OK();
+}
+
+SimZbdBackend::SimZone *SimZbdBackend::ZoneAt(uint64_t pos) {
+  uint64_t idx = pos / zone_sz_;
+  if (idx >= zones_.size()) return nullptr;
+  return &zones_[idx];
+}
+
+bool SimZbdBackend::IsOpen(const SimZone &z) {
+  return z.cond == ZBD_ZONE_COND_IMP_OPEN || z.cond == ZBD_ZONE_COND_EXP_OPEN;
+}
+
+bool SimZbdBackend::IsActive(const SimZone &z) {
+  return IsOpen(z) || z.cond == ZBD_ZONE_COND_CLOSED;
+}
+
+void SimZbdBackend::CountZones(uint32_t *active, uint32_t *open) {
+  *active = 0;
+  *open = 0;
+  for (const auto &z : zones_) {
+    if (IsActive(z)) (*active)++;
+    if (IsOpen(z)) (*open)++;
+  }
+}
+
+IOStatus SimZbdBackend::Reset(uint64_t start, struct zbd_zone *after) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  SimZone *z = ZoneAt(start);
+  if (!z) return IOStatus::IOError("Zone reset failed\n");
+
+  z->wp = z->start;
+  z->cond = ZBD_ZONE_COND_EMPTY;
+  z->data.clear();
+  z->data.shrink_to_fit();
+  /* Give the image blocks back, later reads of the zone return zeroes */
+  if (image_f_ >= 0 &&
+      fallocate(image_f_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                z->start, zone_sz_))
+    return IOStatus::IOError("Zone reset failed\n");
+
+  memset(after, 0, sizeof(*after));
+  after->start = z->start;
+  after->len = zone_sz_;
+  after->capacity = zone_cap_;
+  after->wp = z->wp;
+  after->type = ZBD_ZONE_TYPE_SWR;
+  after->cond = z->cond;
+  return IOStatus::OK();
+}
+
+IOStatus SimZbdBackend::Finish(uint64_t start) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  SimZone *z = ZoneAt(start);
+  if (!z) return IOStatus::IOError("Zone finish failed\n");
+  z->wp = z->start + zone_sz_;
+  z->cond = ZBD_ZONE_COND_FULL;
+  return IOStatus::OK();
+}
+
+IOStatus SimZbdBackend::Close(uint64_t start) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  SimZone *z = ZoneAt(start);
+  if (!z) return IOStatus::IOError("Zone close failed\n");
+  if (IsOpen(*z)) z->cond = ZBD_ZONE_COND_CLOSED;
+  return IOStatus::OK();
+}
+
+ssize_t SimZbdBackend::Write(const char *data, size_t size, uint64_t pos) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  SimZone *z = ZoneAt(pos);
+  uint32_t active, open;
+
+  if (!z || pos != z->wp || (size % block_sz_) ||
+      z->wp + size > z->start + zone_cap_ || z->cond == ZBD_ZONE_COND_FULL) {
+    errno = EIO;
+    return -1;
+  }
+
+  /* Implicit open, subject to the device limits */
+  if (!IsOpen(*z)) {
+    CountZones(&active, &open);
+    if ((max_open_ && open >= max_open_) ||
+        (max_active_ && !IsActive(*z) && active >= max_active_)) {
+      errno = EIO;
+      return -1;
+    }
+    z->cond = ZBD_ZONE_COND_IMP_OPEN;
+  }
+
+  if (image_f_ >= 0) {
+    ssize_t r = pwrite(image_f_, data, size, pos);
+    if (r < 0) return r;
+    size = r;
+  } else if (keep_data_) {
+    z->data.append(data, size);
+  }
+
+  z->wp += size;
+  if (z->wp == z->start + zone_cap_) {
+    z->cond = ZBD_ZONE_COND_FULL;
+    z->wp = z->start + zone_sz_;
+  }
+  return size;
+}
+
+ssize_t SimZbdBackend::Read(char *buf, size_t size, uint64_t pos,
+                            bool /*direct*/) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  SimZone *z = ZoneAt(pos);
+  if (!z) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Never read past the zone, unwritten blocks read as zeroes */
+  size = std::min<uint64_t>(size, z->start + zone_sz_ - pos);
+  if (image_f_ >= 0) return pread(image_f_, buf, size, pos);
+
+  uint64_t off = pos - z->start;
+  size_t have = 0;
+  if (off < z->data.size()) have = std::min<uint64_t>(size, z->data.size() - off);
+  if (have) memcpy(buf, z->data.data() + off, have);
+  memset(buf + have, 0, size - have);
+  return size;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
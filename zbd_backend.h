@@ -0,0 +1,141 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <libzbd/zbd.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rocksdb/io_status.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+struct ZbdDeviceInfo {
+  uint32_t nr_zones;
+  uint64_t zone_sz;
+  uint32_t block_sz;
+  uint32_t max_nr_active_zones; /* 0 means no limit */
+  uint32_t max_nr_open_zones;   /* 0 means no limit */
+  bool host_managed;
+};
+
+/* Zone and data operations of a zoned block device. ZonedBlockDevice only
+ * talks to the device through this, zones are described with libzbd's
+ * struct zbd_zone. */
+class ZbdBackend {
+ public:
+  virtual ~ZbdBackend() {}
+
+  virtual IOStatus Open(bool readonly, ZbdDeviceInfo *info) = 0;
+  virtual IOStatus ListZones(std::vector<struct zbd_zone> *zones) = 0;
+
+  /* Reset a zone and report its state (capacity, offline) afterwards */
+  virtual IOStatus Reset(uint64_t start, struct zbd_zone *after) = 0;
+  virtual IOStatus Finish(uint64_t start) = 0;
+  virtual IOStatus Close(uint64_t start) = 0;
+
+  /* pread/pwrite semantics, -1 on error */
+  virtual ssize_t Write(const char *data, size_t size, uint64_t pos) = 0;
+  virtual ssize_t Read(char *buf, size_t size, uint64_t pos, bool direct) = 0;
+
+  /* File descriptors for callers that submit their own I/O, -1 if the
+   * backend has none */
+  virtual int GetReadFD() { return -1; }
+  virtual int GetReadDirectFD() { return -1; }
+  virtual int GetWriteFD() { return -1; }
+
+  virtual std::string GetFilename() = 0;
+};
+
+/* Host managed zoned block device through libzbd */
+class LibzbdBackend : public ZbdBackend {
+ public:
+  explicit LibzbdBackend(const std::string &bdevname);
+  ~LibzbdBackend();
+
+  IOStatus Open(bool readonly, ZbdDeviceInfo *info) override;
+  IOStatus ListZones(std::vector<struct zbd_zone> *zones) override;
+  IOStatus Reset(uint64_t start, struct zbd_zone *after) override;
+  IOStatus Finish(uint64_t start) override;
+  IOStatus Close(uint64_t start) override;
+  ssize_t Write(const char *data, size_t size, uint64_t pos) override;
+  ssize_t Read(char *buf, size_t size, uint64_t pos, bool direct) override;
+
+  int GetReadFD() override { return read_f_; }
+  int GetReadDirectFD() override { return read_direct_f_; }
+  int GetWriteFD() override { return write_f_; }
+  std::string GetFilename() override { return filename_; }
+
+ private:
+  std::string filename_;
+  uint64_t zone_sz_;
+  uint32_t nr_zones_;
+  int read_f_;
+  int read_direct_f_;
+  int write_f_;
+};
+
+/* Simulated zoned device for offline placement and GC experiments.
+ *
+ * Zone conditions, write pointers and the open/active limits are enforced
+ * like a real host managed drive: writes must land on the write pointer
+ * and opening one zone too many fails. Data goes to a file image when
+ * image_path is set. Without an image only the zone state is tracked and
+ * reads return zeroes, unless keep_data asks for an in memory copy of
+ * everything written (sized like the device, so only for small geometries).
+ * Resetting a zone discards its data in every mode.
+ */
+class SimZbdBackend : public ZbdBackend {
+ public:
+  SimZbdBackend(uint32_t nr_zones, uint64_t zone_sz, uint64_t zone_cap,
+                uint32_t block_sz, uint32_t max_active, uint32_t max_open,
+                const std::string &image_path = "", bool keep_data = false);
+  ~SimZbdBackend();
+
+  IOStatus Open(bool readonly, ZbdDeviceInfo *info) override;
+  IOStatus ListZones(std::vector<struct zbd_zone> *zones) override;
+  IOStatus Reset(uint64_t start, struct zbd_zone *after) override;
+  IOStatus Finish(uint64_t start) override;
+  IOStatus Close(uint64_t start) override;
+  ssize_t Write(const char *data, size_t size, uint64_t pos) override;
+  ssize_t Read(char *buf, size_t size, uint64_t pos, bool direct) override;
+  std::string GetFilename() override;
+
+ private:
+  struct SimZone {
+    uint64_t start;
+    uint64_t wp;
+    uint32_t cond;
+    std::string data; /* memory image, keep_data only */
+  };
+
+  SimZone *ZoneAt(uint64_t pos);
+  bool IsActive(const SimZone &z);
+  bool IsOpen(const SimZone &z);
+  void CountZones(uint32_t *active, uint32_t *open);
+
+  uint32_t nr_zones_;
+  uint64_t zone_sz_;
+  uint64_t zone_cap_;
+  uint32_t block_sz_;
+  uint32_t max_active_;
+  uint32_t max_open_;
+  std::string image_path_;
+  bool keep_data_;
+  int image_f_;
+
+  std::mutex mtx_;
+  std::vector<SimZone> zones_;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <libzbd/zbd.h>
 #include <linux/blkzoned.h>
 #include <stdlib.h>
@@ -23,12 +24,30 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <set>
 
 #include "io_zenfs.h"
+#include "buffer_pool_zenfs.h"
+#include "metrics_zenfs.h"
+#include "multiread_zenfs.h"
+#include "lifecycle_trace_zenfs.h"
+#include "gc_options_zenfs.h"
+#include "gc_rate_zenfs.h"
+#include "reserve_pool_zenfs.h"
+#include "relocation_cache_zenfs.h"
+#include "zone_io_zenfs.h"
+#include "zbd_backend.h"
 #include "rocksdb/env.h"
 #include "db/version_set.h"
 #include "db/dbformat.h"
@@ -47,6 +66,15 @@ using std::fixed;
  */
 #define ZENFS_META_ZONES (3)
 
+/* Direct reads bounce through pooled buffers of this size */
+#define ZENFS_READ_BUFFER_SIZE (1 * MB)
+#define ZENFS_READ_BUFFER_POOL (32)
+
+/* GC reads a file's extents in a victim in batches of at most this many
+ * bytes and extents, all of a batch in flight at once */
+#define ZENFS_GC_READ_BATCH (4 * MB)
+#define ZENFS_GC_READ_BATCH_EXTENTS (16)
+
 /* Minimum of number of zones that makes sense */
 #define ZENFS_MIN_ZONES (32)
 
@@ -62,11 +90,15 @@ Zone::Zone(ZonedBlockDevice *zbd, struct zbd_zone *z, const uint32_t id)
       max_capacity_(zbd_zone_capacity(z)),
       wp_(zbd_zone_wp(z)),
       open_for_write_(false),
-      is_append(false){
+      is_append(false),
+      write_source_(ZENFS_WR_WAL),
+      write_level_(-1),
+      gc_kept_(false){
   lifetime_ = Env::WLTH_NOT_SET;
   secondary_lifetime_ = Env::WLTH_NOT_SET;
   used_capacity_ = 0;
   capacity_ = 0;
+  for (int i = 0; i < ZENFS_ZONE_REGIONS; i++) region_invalid_[i] = 0;
   if (!(zbd_zone_full(z) || zbd_zone_offline(z) || zbd_zone_rdonly(z)))
     capacity_ = zbd_zone_capacity(z) - (zbd_zone_wp(z) - zbd_zone_start(z));
 }
@@ -123,20 +155,16 @@ void Zone::CloseWR() {
 }
 
 IOStatus Zone::Reset() {
-  size_t zone_sz = zbd_->GetZoneSize();
-  int fd = zbd_->GetWriteFD();
-  unsigned int report = 1;
   struct zbd_zone z;
-  int ret;
+  IOStatus s;
 
   assert(!IsUsed());
 
-  ret = zbd_reset_zones(fd, start_, zone_sz);
-  if (ret) return IOStatus::IOError("Zone reset failed\n");
-
-  ret = zbd_report_zones(fd, start_, zone_sz, ZBD_RO_ALL, &z, &report);
-
-  if (ret || (report != 1)) return IOStatus::IOError("Zone report failed\n");
+  {
+    ZenFSZoneIO::Scope io(zbd_->GetZoneIO(), start_, ZENFS_ZOP_RESET, 0);
+    s = zbd_->GetBackend()->Reset(start_, &z);
+  }
+  if (!s.ok()) return s;
 
   if (zbd_zone_offline(&z))
     capacity_ = 0;
@@ -145,6 +173,10 @@ IOStatus Zone::Reset() {
 
   wp_ = start_;
   lifetime_ = Env::WLTH_NOT_SET;
+  gc_kept_ = false;
+  zbd_->GetZoneIO()->ClearReadHeat(start_);
+  for (int i = 0; i < ZENFS_ZONE_REGIONS; i++) region_invalid_[i] = 0;
+  zbd_->GetMetrics()->resets++;
 
   for(auto ext : extent_info_){
     delete ext;
@@ -155,30 +187,29 @@ IOStatus Zone::Reset() {
 
 IOStatus Zone::Finish() {
   size_t zone_sz = zbd_->GetZoneSize();
-  int fd = zbd_->GetWriteFD();
-  int ret;
+  IOStatus s;
 
   assert(!open_for_write_);
 
-  ret = zbd_finish_zones(fd, start_, zone_sz);
-  if (ret) return IOStatus::IOError("Zone finish failed\n");
+  {
+    ZenFSZoneIO::Scope io(zbd_->GetZoneIO(), start_, ZENFS_ZOP_FINISH, 0);
+    s = zbd_->GetBackend()->Finish(start_);
+  }
+  if (!s.ok()) return s;
 
   capacity_ = 0;
   wp_ = start_ + zone_sz;
+  zbd_->GetMetrics()->finishes++;
 
   return IOStatus::OK();
 }
 
 IOStatus Zone::Close() {
-  size_t zone_sz = zbd_->GetZoneSize();
-  int fd = zbd_->GetWriteFD();
-  int ret;
-
   assert(!open_for_write_);
 
   if (!(IsEmpty() || IsFull())) {
-    ret = zbd_close_zones(fd, start_, zone_sz);
-    if (ret) return IOStatus::IOError("Zone close failed\n");
+    IOStatus s = zbd_->GetBackend()->Close(start_);
+    if (!s.ok()) return s;
   }
 
   return IOStatus::OK();
@@ -187,16 +218,20 @@ IOStatus Zone::Close() {
 IOStatus Zone::Append(char *data, uint32_t size) {
   char *ptr = data;
   uint32_t left = size;
-  int fd = zbd_->GetWriteFD();
+  ZbdBackend *backend = zbd_->GetBackend();
   int ret = -1;
 
   if (capacity_ < size)
     return IOStatus::NoSpace("Not enough capacity for append");
 
   assert((size % zbd_->GetBlockSize()) == 0);
+  ZenFSZoneIO::Scope io(zbd_->GetZoneIO(), start_,
+                        write_source_ == ZENFS_WR_GC ? ZENFS_ZOP_GC_COPY
+                                                     : ZENFS_ZOP_APPEND,
+                        size);
 
   while (left) {
-    ret = pwrite(fd, ptr, size, wp_);
+    ret = backend->Write(ptr, left, wp_);
     if (ret < 0){
         return IOStatus::IOError("Write failed in Zone Append");
     }
@@ -206,10 +241,20 @@ IOStatus Zone::Append(char *data, uint32_t size) {
     zone_df_lock_.unlock();
     capacity_ -= ret;
     left -= ret;
+    zbd_->GetMetrics()->RecordWrite((ZenFSWriteSource)write_source_,
+                                    write_level_, ret);
   }
   return IOStatus::OK();
 }
 
+/* Sub-zone region (1/ZENFS_ZONE_REGIONS of the zone) holding offset */
+int Zone::RegionOf(uint64_t offset) {
+  uint64_t zone_sz = zbd_->GetZoneSize();
+  if (offset < start_ || zone_sz == 0) return 0;
+  uint64_t r = (offset - start_) * ZENFS_ZONE_REGIONS / zone_sz;
+  return r < ZENFS_ZONE_REGIONS ? (int)r : ZENFS_ZONE_REGIONS - 1;
+}
+
 void Zone::Invalidate(ZoneExtent* extent) {
 
   bool found = false;
@@ -223,6 +268,7 @@ void Zone::Invalidate(ZoneExtent* extent) {
                   fprintf(stderr, "Duplicate Extent in Invalidate (%p == %p)\n", ex->extent_, extent);
               }
               ex->invalidate();
+              region_invalid_[RegionOf(extent->start_)] += extent->length_;
               found = true;
           }
       }
@@ -259,8 +305,22 @@ Zone *ZonedBlockDevice::GetIOZone(uint64_t offset) {
 
 ZonedBlockDevice::ZonedBlockDevice(std::string bdevname,
                                    std::shared_ptr<Logger> logger)
-    : filename_("/dev/" + bdevname), logger_(logger), db_ptr_(nullptr) {
+    : ZonedBlockDevice(new LibzbdBackend(bdevname), logger) {}
+
+/* Takes ownership of the backend */
+ZonedBlockDevice::ZonedBlockDevice(ZbdBackend *backend,
+                                   std::shared_ptr<Logger> logger)
+    : backend_(backend),
+      filename_(backend->GetFilename()),
+      logger_(logger),
+      db_ptr_(nullptr),
+      direct_reads_(false),
+      read_buffers_(nullptr),
+      reloc_cache_(&metrics_) {
   Info(logger_, "New Zoned Block Device: %s", filename_.c_str());
+  gc_thread_stop_ = false;
+  gc_zones_wanted_ = 0;
+  for (int i = 0; i < ZENFS_GC_STREAMS; i++) gc_streams_[i] = nullptr;
   zc_in_progress_.store(false);
   WR_DATA.store(0);
   LAST_WR_DATA.store(100);
@@ -270,39 +330,417 @@ ZonedBlockDevice::ZonedBlockDevice(std::string bdevname,
 
 void ZonedBlockDevice::SetDBPointer(DBImpl* db) {
     db_ptr_ = db;
+
+    ZenFSHooks hooks;
+    hooks.get_property = [this](const std::string &name, std::string *value,
+                                std::map<std::string, std::string> *map_value) {
+      return GetZenFSProperty(name, value, map_value);
+    };
+    hooks.get_stats_map = [this](std::map<std::string, uint64_t> *stats) {
+      std::map<std::string, uint64_t> counters;
+      metrics_.GetCounters(&counters);
+      for (const auto &c : counters) (*stats)["zenfs." + c.first] = c.second;
+    };
+    hooks.dump_stats = [this](std::string *out) {
+      metrics_.HistogramsToString(out);
+      zone_io_.SummaryToString(out);
+      out->append("** ZenFS write amplification **\n");
+      metrics_.WriteAmpToString(out);
+    };
+    hooks.start_trace = [this](Env *env, const TraceOptions &options,
+                               std::unique_ptr<TraceWriter> &&writer) {
+      return lifecycle_tracer_.Start(env, options, std::move(writer));
+    };
+    hooks.end_trace = [this]() { return lifecycle_tracer_.End(); };
+    hooks.trace_compaction = [this](uint64_t job_id,
+                                    const std::vector<uint64_t> &inputs,
+                                    const std::vector<uint64_t> &outputs) {
+      lifecycle_tracer_.RecordCompaction(job_id, inputs, outputs);
+    };
+    hooks.trace_table_file = [this](uint64_t fno, int level,
+                                    Env::WriteLifeTimeHint lifetime,
+                                    const Slice &smallest,
+                                    const Slice &largest, uint64_t size) {
+      lifecycle_tracer_.RecordCreate(fno, level, lifetime, smallest, largest);
+      lifecycle_tracer_.RecordAppend(fno, size);
+      lifecycle_tracer_.RecordClose(fno);
+    };
+    hooks.trace_table_deleted = [this](uint64_t fno) {
+      lifecycle_tracer_.RecordDelete(fno);
+    };
+    hooks.set_options =
+        [this](const std::unordered_map<std::string, std::string> &opts) {
+          return SetGCOptions(opts);
+        };
+    hooks.check_options =
+        [this](const std::unordered_map<std::string, std::string> &opts) {
+          return CheckGCOptions(opts);
+        };
+    hooks.file_zone = [this](uint64_t fno) { return GetFileZone(fno); };
+    hooks.zone_reclaim_benefit =
+        [this](const std::vector<std::vector<uint64_t>> &file_sets,
+               std::vector<uint64_t> *zones_freed) {
+          GetReclaimBenefits(file_sets, zones_freed);
+        };
+    hooks.co_schedule = [this]() { return GetGCOptions().co_schedule; };
+    hooks.pinning_files = [this](std::vector<uint64_t> *fnos) {
+      GetPinningFiles(fnos);
+    };
+    hooks.drain_marked = [this](const std::vector<uint64_t> &fnos) {
+      CountDrainedFiles(fnos);
+    };
+    hooks.files_purged = [this]() { ResetPurgedZones(); };
+    db_ptr_->SetZenFSHooks(hooks);
 }
 
-IOStatus ZonedBlockDevice::Open(bool readonly) {
-  struct zbd_zone *zone_rep;
-  unsigned int reported_zones;
-  size_t addr_space_sz;
-  zbd_info info;
-  Status s;
-  uint64_t i = 0;
-  uint64_t m = 0;
-  uint64_t r = 0;
-  int ret;
-  uint32_t zone_cnt = 0;
-  read_f_ = zbd_open(filename_.c_str(), O_RDONLY, &info);
-  if (read_f_ < 0) {
-    return IOStatus::InvalidArgument("Failed to open zoned block device");
+/* Zone holding the head of an SST, UINT64_MAX for files not on the device */
+uint64_t ZonedBlockDevice::GetFileZone(uint64_t fno) {
+  uint64_t zone = UINT64_MAX;
+  sst_zone_mtx_.lock();
+  auto it = sst_to_zone_.find(fno);
+  if (it != sst_to_zone_.end() && !it->second.empty())
+    zone = (uint64_t)it->second.front();
+  sst_zone_mtx_.unlock();
+  return zone;
+}
+
+/* Number of zones whose valid data belongs only to the given SSTs, so they
+ * could be reset without a copy once those files are gone. Zones still open
+ * for writes or being filled by GC never count, more data may land in
+ * them. */
+uint64_t ZonedBlockDevice::GetReclaimBenefit(
+    const std::vector<uint64_t> &fnos) {
+  std::vector<uint64_t> freed;
+  GetReclaimBenefits({fnos}, &freed);
+  return freed[0];
+}
+
+/* GetReclaimBenefit() of every file set. Each zone touched by any set has
+ * its extent list walked once under io_zones_mtx, the sets are then scored
+ * from the valid SST bytes per file gathered there. */
+void ZonedBlockDevice::GetReclaimBenefits(
+    const std::vector<std::vector<uint64_t>> &file_sets,
+    std::vector<uint64_t> *freed) {
+  struct ZoneValid {
+    uint64_t used;
+    std::map<uint64_t, uint64_t> sst_bytes;
+  };
+  std::vector<std::set<int>> set_zids(file_sets.size());
+  std::map<int, ZoneValid> zones;
+
+  freed->assign(file_sets.size(), 0);
+  sst_zone_mtx_.lock();
+  for (size_t i = 0; i < file_sets.size(); i++) {
+    for (uint64_t fno : file_sets[i]) {
+      auto it = sst_to_zone_.find(fno);
+      if (it != sst_to_zone_.end())
+        set_zids[i].insert(it->second.begin(), it->second.end());
+    }
   }
+  sst_zone_mtx_.unlock();
+  for (const auto &zids : set_zids)
+    for (int zid : zids) zones[zid];
 
-  read_direct_f_ = zbd_open(filename_.c_str(), O_RDONLY, &info);
-  if (read_f_ < 0) {
-    return IOStatus::InvalidArgument("Failed to open zoned block device");
+  io_zones_mtx.lock();
+  for (auto zit = zones.begin(); zit != zones.end();) {
+    auto it = id_to_zone_.find(zit->first);
+    Zone *z = it == id_to_zone_.end() ? nullptr : it->second;
+    if (!z || z->open_for_write_ || z->IsEmpty() || reserve_pool_.IsHeld(z)) {
+      zit = zones.erase(zit);
+      continue;
+    }
+    zit->second.used = z->used_capacity_;
+    for (auto ex : z->extent_info_) {
+      if (ex->valid_ && ex->zone_file_ && ex->zone_file_->is_sst_)
+        zit->second.sst_bytes[ex->zone_file_->fno_] += ex->extent_->length_;
+    }
+    ++zit;
   }
+  io_zones_mtx.unlock();
 
-  if (readonly) {
-    write_f_ = -1;
-  } else {
-    write_f_ = zbd_open(filename_.c_str(), O_WRONLY | O_DIRECT, &info);
-    if (write_f_ < 0) {
-      return IOStatus::InvalidArgument("Failed to open zoned block device");
+  for (size_t i = 0; i < file_sets.size(); i++) {
+    for (int zid : set_zids[i]) {
+      auto zit = zones.find(zid);
+      if (zit == zones.end()) continue;
+      uint64_t dying_bytes = 0;
+      std::set<uint64_t> counted;
+      for (uint64_t fno : file_sets[i]) {
+        if (!counted.insert(fno).second) continue;
+        auto b = zit->second.sst_bytes.find(fno);
+        if (b != zit->second.sst_bytes.end()) dying_bytes += b->second;
+      }
+      if (dying_bytes > 0 && dying_bytes >= zit->second.used) (*freed)[i]++;
     }
   }
+}
+
+/* SSTs whose compaction would empty nearly invalid zones. Candidates are
+ * full io zones at most drain_valid_pct valid whose valid extents all
+ * belong to SSTs, taken least valid first, at most ZENFS_GC_DRAIN_ZONES
+ * per call. Once the DB has rewritten those files the zones are reset by
+ * AllocateZone without GC copying anything out of them. */
+void ZonedBlockDevice::GetPinningFiles(std::vector<uint64_t> *fnos) {
+  ZenFSGCOptions gc_opts = GetGCOptions();
+  std::vector<std::pair<uint64_t, Zone *>> candidates;
+  std::set<uint64_t> pinning;
+  uint64_t zones = 0;
+
+  fnos->clear();
+  if (gc_opts.drain_valid_pct <= 0) return;
+
+  io_zones_mtx.lock();
+  for (auto z : io_zones) {
+    if (z->open_for_write_ || !z->IsFull() || !z->IsUsed()) continue;
+    uint64_t written = z->wp_ - z->start_;
+    uint64_t valid = z->used_capacity_.load();
+    if (valid * 100 > written * gc_opts.drain_valid_pct) continue;
+    candidates.push_back(std::make_pair(valid, z));
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<uint64_t, Zone *> &a,
+               const std::pair<uint64_t, Zone *> &b) {
+              return a.first < b.first;
+            });
+
+  for (auto &c : candidates) {
+    std::set<uint64_t> files;
+    bool sst_only = true;
+    for (auto ex : c.second->extent_info_) {
+      if (!ex->valid_) continue;
+      if (!ex->zone_file_ || !ex->zone_file_->is_sst_) {
+        sst_only = false;
+        break;
+      }
+      files.insert(ex->zone_file_->fno_);
+    }
+    /* WAL and manifest data can't be moved by a compaction */
+    if (!sst_only || files.empty()) continue;
+    pinning.insert(files.begin(), files.end());
+    if (++zones >= ZENFS_GC_DRAIN_ZONES) break;
+  }
+  io_zones_mtx.unlock();
+
+  fnos->assign(pinning.begin(), pinning.end());
+}
+
+/* Files the DB newly marked for compaction off GetPinningFiles(), with the
+ * zones their compaction will empty. Files still marked from an earlier
+ * call are not reported again. */
+void ZonedBlockDevice::CountDrainedFiles(const std::vector<uint64_t> &fnos) {
+  metrics_.drain_zones += GetReclaimBenefit(fnos);
+  metrics_.drain_files += fnos.size();
+}
+
+/* Foreground state for GCRateController, all zero without a DB */
+ZenFSWritePressure ZonedBlockDevice::GetWritePressure() {
+  ZenFSWritePressure p;
+  if (db_ptr_) {
+    db_ptr_->GetZenFSWritePressure(&p.stopped, &p.delayed,
+                                   &p.delayed_write_rate,
+                                   &p.pending_compaction_bytes);
+  }
+  return p;
+}
+
+ZenFSGCOptions ZonedBlockDevice::GetGCOptions() {
+  std::lock_guard<std::mutex> lk(gc_options_mtx_);
+  return gc_options_;
+}
+
+Status ZonedBlockDevice::CheckGCOptions(
+    const std::unordered_map<std::string, std::string> &opts) {
+  ZenFSGCOptions n = GetGCOptions();
+  return n.Apply(opts);
+}
+
+Status ZonedBlockDevice::SetGCOptions(
+    const std::unordered_map<std::string, std::string> &opts) {
+  ZenFSGCOptions applied;
+  {
+    std::lock_guard<std::mutex> lk(gc_options_mtx_);
+    Status s = gc_options_.Apply(opts);
+    if (!s.ok()) return s;
+    applied = gc_options_;
+  }
+  Info(logger_, "ZenFS GC options: %s\n", applied.ToString().c_str());
+
+  /* Cleaning reads the options under io_zones_mtx, so never take it while
+   * holding gc_options_mtx_ */
+  io_zones_mtx.lock();
+  reserve_pool_.SetLimits(applied.reserve_min, applied.reserve_max,
+                          io_zones.size());
+  CloseGCStreams(applied.streams);
+  io_zones_mtx.unlock();
+  return Status::OK();
+}
+
+/* rocksdb.zenfs.<name> properties
+ *   stats          all device counters (map or "name: value" lines)
+ *   zone-stats     per data zone written/valid/invalid/capacity bytes and
+ *                  invalidated bytes per sub-zone region
+ *   write-amp      device bytes per host byte, overall and per level
+ *   gc-options     current inline GC policy
+ *   gc-rate        adaptive GC urgency and copy rate (bytes/s, 0 unlimited)
+ *   zone-io        per zone and operation latency (micros) and in-flight
+ *   io-inflight    operations in progress on the device, per operation
+ *   <counter>      a single device counter, e.g. gc-bytes-copied
+ * Only atomics and zone fields are read, no extent lists are walked and
+ * io_zones_mtx is never taken, so a scrape does not wait for a cleaning
+ * pass and allocation does not wait for a scrape. */
+/* Copy the per zone counters of every data zone (io zones and the reserve
+ * pool) without io_zones_mtx. Zones are walked through id_to_zone_, which
+ * is fixed after Open(), and the write pointer is read under the zone's
+ * own lock as GetTotalWritten() does. Fields of a zone being written may
+ * be a little apart from each other, which a monitoring scrape tolerates. */
+void ZonedBlockDevice::SnapshotZoneStats(
+    std::vector<ZoneStatsSnapshot> *zones) {
+  std::set<Zone *> meta(meta_zones.begin(), meta_zones.end());
+  zones->reserve(id_to_zone_.size());
+  for (const auto &it : id_to_zone_) {
+    Zone *z = it.second;
+    if (meta.count(z)) continue;
+    ZoneStatsSnapshot s;
+    s.zone_id = z->zone_id_;
+    z->zone_df_lock_.lock();
+    s.written = z->wp_ - z->start_;
+    z->zone_df_lock_.unlock();
+    s.valid = z->used_capacity_.load();
+    s.capacity = z->capacity_;
+    s.max_capacity = z->max_capacity_;
+    s.open = z->open_for_write_;
+    for (int r = 0; r < ZENFS_ZONE_REGIONS; r++)
+      s.region_invalid[r] = z->region_invalid_[r];
+    zones->push_back(s);
+  }
+}
+
+bool ZonedBlockDevice::GetZenFSProperty(
+    const std::string &name, std::string *value,
+    std::map<std::string, std::string> *map_value) {
+  std::map<std::string, uint64_t> counters;
 
-  if (info.model != ZBD_DM_HOST_MANAGED) {
+  if (name == "gc-options") {
+    std::string opts = GetGCOptions().ToString();
+    if (value) *value = opts;
+    if (map_value) (*map_value)[name] = opts;
+    return true;
+  }
+
+  if (name == "gc-rate") {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "urgency: %.3f rate: %" PRIu64,
+             gc_rate_.GetUrgency(), gc_rate_.GetRate());
+    if (value) *value = buf;
+    if (map_value) {
+      (*map_value)["urgency"] = std::to_string(gc_rate_.GetUrgency());
+      (*map_value)["rate"] = std::to_string(gc_rate_.GetRate());
+    }
+    return true;
+  }
+
+  if (name == "zone-io") {
+    if (value) zone_io_.ToString(value);
+    if (map_value) zone_io_.ToMap(map_value);
+    return true;
+  }
+
+  if (name == "io-inflight") {
+    for (uint32_t op = 0; op < ZENFS_ZOP_NUM; op++) {
+      uint64_t n = zone_io_.InFlight((ZenFSZoneOp)op);
+      if (value)
+        value->append(std::string(ZenFSZoneOpName(op)) + ": " +
+                      std::to_string(n) + "\n");
+      if (map_value) (*map_value)[ZenFSZoneOpName(op)] = std::to_string(n);
+    }
+    return true;
+  }
+
+  if (name == "zone-stats") {
+    char buf[160];
+    std::vector<ZoneStatsSnapshot> zones;
+    SnapshotZoneStats(&zones);
+    for (const auto &z : zones) {
+      uint64_t invalid = (z.written > z.valid) ? (z.written - z.valid) : 0;
+      std::string id = std::to_string(z.zone_id);
+      if (map_value) {
+        (*map_value)[id + ".written"] = std::to_string(z.written);
+        (*map_value)[id + ".valid"] = std::to_string(z.valid);
+        (*map_value)[id + ".invalid"] = std::to_string(invalid);
+        (*map_value)[id + ".capacity"] = std::to_string(z.capacity);
+        (*map_value)[id + ".max-capacity"] = std::to_string(z.max_capacity);
+        for (int r = 0; r < ZENFS_ZONE_REGIONS; r++)
+          (*map_value)[id + ".region-invalid." + std::to_string(r)] =
+              std::to_string(z.region_invalid[r]);
+      }
+      if (value) {
+        snprintf(buf, sizeof(buf),
+                 "zone %4u written %12lu valid %12lu invalid %12lu "
+                 "capacity %12lu%s\n",
+                 z.zone_id, z.written, z.valid, invalid, z.capacity,
+                 z.open ? " open" : "");
+        value->append(buf);
+      }
+    }
+    return true;
+  }
+
+  metrics_.GetCounters(&counters);
+  counters["active-zones"] = active_io_zones_.load();
+  counters["open-zones"] = open_io_zones_.load();
+  counters["reserved-zones"] = reserve_pool_.FreeCount();
+  counters["reserved-zones-held"] = reserve_pool_.HeldCount();
+  counters["reserved-zones-target"] = reserve_pool_.Target();
+  counters["reloc-cache-bytes"] = reloc_cache_.Bytes();
+  counters["wr-data"] = WR_DATA.load();
+
+  if (name == "stats") {
+    for (const auto &c : counters) {
+      if (map_value) (*map_value)[c.first] = std::to_string(c.second);
+      if (value) value->append(c.first + ": " + std::to_string(c.second) + "\n");
+    }
+    if (map_value)
+      (*map_value)["last-alloc-path"] =
+          ZenFSAllocPathName(metrics_.last_alloc_path.load());
+    if (value)
+      value->append(std::string("last-alloc-path: ") +
+                    ZenFSAllocPathName(metrics_.last_alloc_path.load()) + "\n");
+    return true;
+  }
+
+  if (name == "write-amp") {
+    std::string wa;
+    metrics_.WriteAmpToString(&wa);
+    if (value) *value = wa;
+    if (map_value) (*map_value)["write-amp"] = wa;
+    return true;
+  }
+
+  if (name == "last-alloc-path") {
+    if (value) *value = ZenFSAllocPathName(metrics_.last_alloc_path.load());
+    return true;
+  }
+
+  auto it = counters.find(name);
+  if (it == counters.end()) return false;
+  if (value) *value = std::to_string(it->second);
+  if (map_value) (*map_value)[name] = std::to_string(it->second);
+  return true;
+}
+
+IOStatus ZonedBlockDevice::Open(bool readonly) {
+  std::vector<struct zbd_zone> zone_rep;
+  size_t reported_zones;
+  ZbdDeviceInfo info;
+  IOStatus s;
+  uint64_t i = 0;
+  uint64_t m = 0;
+  uint64_t r = 0;
+  uint32_t zone_cnt = 0;
+
+  s = backend_->Open(readonly, &info);
+  if (!s.ok()) return s;
+
+  if (!info.host_managed) {
     return IOStatus::NotSupported("Not a host managed block device");
   }
 
@@ -311,9 +749,13 @@ IOStatus ZonedBlockDevice::Open(bool readonly) {
         "To few zones on zoned block device (32 required)");
   }
 
-  block_sz_ = info.pblock_size;
-  zone_sz_ = info.zone_size;
+  block_sz_ = info.block_sz;
+  zone_sz_ = info.zone_sz;
   nr_zones_ = info.nr_zones;
+  zone_io_.Init(info.nr_zones, zone_sz_);
+
+  read_buffers_ = new AlignedBufferPool(block_sz_, ZENFS_READ_BUFFER_SIZE,
+                                        ZENFS_READ_BUFFER_POOL);
 
   /* We need one open zone for meta data writes, the rest can be used for files
    */
@@ -330,15 +772,12 @@ IOStatus ZonedBlockDevice::Open(bool readonly) {
   Info(logger_, "Zone block device nr zones: %u max active: %u max open: %u \n",
        info.nr_zones, info.max_nr_active_zones, info.max_nr_open_zones);
 
-  addr_space_sz = (uint64_t)nr_zones_ * zone_sz_;
-
-  ret = zbd_list_zones(read_f_, 0, addr_space_sz, ZBD_RO_ALL, &zone_rep,
-                       &reported_zones);
-
-  if (ret || reported_zones != nr_zones_) {
-    Error(logger_, "Failed to list zones, err: %d", ret);
-    return IOStatus::IOError("Failed to list zones");
+  s = backend_->ListZones(&zone_rep);
+  if (!s.ok()) {
+    Error(logger_, "Failed to list zones: %s", s.ToString().c_str());
+    return s;
   }
+  reported_zones = zone_rep.size();
 
   while (m < ZENFS_META_ZONES && i < reported_zones) {
     struct zbd_zone *z = &zone_rep[i++];
@@ -354,14 +793,14 @@ IOStatus ZonedBlockDevice::Open(bool readonly) {
     }
   }
  
-  //(TODO)::Should reserved zone be treated as active_io_zones_?
-  while(r <= RESERVED_ZONE_FOR_CLEANING && i < reported_zones) {
+  std::vector<Zone *> reserve;
+  while(r < RESERVED_ZONE_FOR_CLEANING && i < reported_zones) {
     struct zbd_zone *z = &zone_rep[i++];
     /* Only use sequential write required zones */
     if (zbd_zone_type(z) == ZBD_ZONE_TYPE_SWR) {
       if (!zbd_zone_offline(z)) {
         Zone* new_zone = new Zone(this, z, zone_cnt);
-        reserved_zones.push_back(new_zone);
+        reserve.push_back(new_zone);
         id_to_zone_.insert(std::pair<int,Zone*>(zone_cnt, new_zone));
         zone_cnt++;
       }
@@ -372,6 +811,14 @@ IOStatus ZonedBlockDevice::Open(bool readonly) {
   active_io_zones_ = 0;
   open_io_zones_ = 0;
 
+  /* Reserve candidates holding data from before a remount are io zones */
+  std::vector<Zone *> rejected;
+  reserve_pool_.Init(reserve, &rejected);
+  for (const auto z : rejected) {
+    io_zones.push_back(z);
+    if (!z->IsFull() && !z->IsEmpty()) active_io_zones_++;
+  }
+
   for (; i < reported_zones; i++) {
     struct zbd_zone *z = &zone_rep[i];
     /* Only use sequential write required zones */
@@ -395,12 +842,33 @@ IOStatus ZonedBlockDevice::Open(bool readonly) {
     }
   }
 
-  free(zone_rep);
+  reserve_pool_.SetLimits(0, 0, io_zones.size());
   start_time_ = time(NULL);
 
+  if (!readonly)
+    gc_thread_ = std::thread(&ZonedBlockDevice::BackgroundGC, this);
+
   return IOStatus::OK();
 }
 
+static uint64_t MicrosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/* Block until an open zone slot is free, time spent here is reported as
+ * allocation wait time */
+void ZonedBlockDevice::WaitForOpenIOZoneToken() {
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lk(zone_resources_mtx_);
+  zone_resources_.wait(lk, [this] {
+    if (open_io_zones_.load() < max_nr_open_io_zones_) return true;
+    return false;
+  });
+  metrics_.RecordAllocWait(MicrosSince(start));
+}
+
 void ZonedBlockDevice::NotifyIOZoneFull() {
   const std::lock_guard<std::mutex> lock(zone_resources_mtx_);
   active_io_zones_--;
@@ -457,7 +925,13 @@ void ZonedBlockDevice::LogZoneUsage() {
 }
 
 ZonedBlockDevice::~ZonedBlockDevice() {
-  
+  {
+    std::lock_guard<std::mutex> lk(gc_thread_mtx_);
+    gc_thread_stop_ = true;
+  }
+  gc_thread_cv_.notify_all();
+  if (gc_thread_.joinable()) gc_thread_.join();
+
   for (const auto z : meta_zones) {
     delete z;
   }
@@ -465,9 +939,79 @@ ZonedBlockDevice::~ZonedBlockDevice() {
   for (const auto z : io_zones) {
     delete z;
   }
-  zbd_close(read_f_);
-  zbd_close(read_direct_f_);
-  zbd_close(write_f_);
+
+  std::vector<Zone *> reserve;
+  reserve_pool_.GetZones(&reserve);
+  for (const auto z : reserve) {
+    delete z;
+  }
+  delete read_buffers_;
+  delete backend_;
+}
+
+void ZonedBlockDevice::SetDirectReads(bool direct) {
+  Info(logger_, "ZenFS reads: %s\n", direct ? "direct" : "buffered");
+  direct_reads_.store(direct);
+}
+
+/* Read n bytes at device offset dev_off into dst.
+ * Buffered mode is a plain read. In direct mode the request is widened to
+ * whole blocks; when dst, offset and length are already aligned the data
+ * goes straight into dst, otherwise it bounces through a pooled buffer so
+ * partial blocks at extent edges are handled. Returns bytes read or -1. */
+ssize_t ZonedBlockDevice::ReadData(uint64_t dev_off, size_t n, char *dst) {
+  ZenFSZoneIO::Scope io(&zone_io_, dev_off, ZENFS_ZOP_READ, n);
+  size_t done = 0;
+
+  if (!direct_reads_.load()) {
+    while (done < n) {
+      ssize_t r = backend_->Read(dst + done, n - done, dev_off + done, false);
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0) return -1;
+      if (r == 0) break;
+      done += r;
+    }
+    return done;
+  }
+
+  if (((uintptr_t)dst % block_sz_) == 0 && (dev_off % block_sz_) == 0 &&
+      (n % block_sz_) == 0) {
+    while (done < n) {
+      ssize_t r = backend_->Read(dst + done, n - done, dev_off + done, true);
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0) return -1;
+      if (r == 0) break;
+      done += r;
+    }
+    return done;
+  }
+
+  size_t chunk = read_buffers_->GetBufferSize();
+  char *bounce = read_buffers_->Get(chunk);
+  if (!bounce) return -1;
+
+  while (done < n) {
+    uint64_t off = dev_off + done;
+    uint64_t aligned_off = off - (off % block_sz_);
+    size_t skip = off - aligned_off;
+    size_t len = std::min(n - done, chunk - skip);
+    size_t aligned_len = skip + len;
+    if (aligned_len % block_sz_)
+      aligned_len += block_sz_ - (aligned_len % block_sz_);
+
+    ssize_t r = backend_->Read(bounce, aligned_len, aligned_off, true);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      read_buffers_->Put(bounce, chunk);
+      return -1;
+    }
+    if ((size_t)r <= skip) break;
+    len = std::min(len, (size_t)r - skip);
+    memcpy(dst + done, bounce + skip, len);
+    done += len;
+  }
+  read_buffers_->Put(bounce, chunk);
+  return done;
 }
 
 #define LIFETIME_DIFF_NOT_GOOD (100)
@@ -529,6 +1073,7 @@ Zone *ZonedBlockDevice::AllocateMetaZone() {
           continue;
         }
       }
+      z->write_source_ = ZENFS_WR_META;
       return z;
     }
   }
@@ -545,6 +1090,25 @@ void ZonedBlockDevice::ResetUnusedIOZones() {
     }
   }
 }
+
+/* Called once per batch of files the DB purged. The zones the batch left
+ * without valid data are reset in one pass here, off the write path,
+ * rather than by the next AllocateZone(). Same conditions as the reset
+ * loop there. Files the SstFileManager moved to trash free their zones
+ * later and are picked up by AllocateZone() as before. */
+void ZonedBlockDevice::ResetPurgedZones() {
+  metrics_.purge_batches++;
+  io_zones_mtx.lock();
+  for (const auto z : io_zones) {
+    if (z->open_for_write_ || z->IsEmpty() || z->IsUsed()) continue;
+    if (!z->IsFull()) active_io_zones_--;
+    if (z->Reset().ok())
+      metrics_.purge_resets++;
+    else
+      Warn(logger_, "Failed reseting zone");
+  }
+  io_zones_mtx.unlock();
+}
 /*(TODO)
 void ZonedBlockDevice::PickZoneWithCompactionVictim(std::vector<Zone*>& candidates) {
  io_zones_mtx should be locked before the function is called 
@@ -739,15 +1303,17 @@ Zone* ZonedBlockDevice::AllocateMostL0Files(const std::set<int>& zone_list) {
 
 void ZonedBlockDevice::SameLevelFileList(const int level, std::vector<uint64_t>& fno_list){
     fno_list.clear();
+    if (!db_ptr_) return;
     db_ptr_->SameLevelFileList(level, fno_list);
 }
 
 void ZonedBlockDevice::AdjacentFileList(const InternalKey& s, const InternalKey& l, const int level, std::vector<uint64_t>& fno_list){
-    if(level == 100) return;
+    if(level == 100 || !db_ptr_) return;
     db_ptr_->AdjacentFileList(s, l, level, fno_list);
 }
 void ZonedBlockDevice::AllFile(const InternalKey& s, const InternalKey& l,std::vector<uint64_t>& fno_list) {//ȡȫ㼶ļ
    fno_list.clear();
+   if (!db_ptr_) return;
    int levelnum = db_ptr_->Getlevel();
    for (int level = 0; level < levelnum; ++level) {
      std::vector<uint64_t> temp_list;
@@ -768,23 +1334,100 @@ uint64_t ZonedBlockDevice::HexString(ParsedInternalKey* result) {
 
 
 }
+/* Bookkeeping for every AllocateZone exit. The zone is owned by one file
+ * until it is closed, so its appends are charged to that file's level. */
+void ZonedBlockDevice::RecordAllocation(
+    Zone *zone, ZenFSAllocPath path, int level,
+    std::chrono::steady_clock::time_point start) {
+  metrics_.RecordAllocPath(path, MicrosSince(start));
+  if (zone) {
+    zone->write_source_ = ZenFSWriteSourceForLevel(level);
+    zone->write_level_ = level;
+  }
+}
+
+/* Refill gc_queue_ with the zones worth cleaning, returns their invalid
+ * bytes. Greedy ranks by padded invalid extent bytes. Cost-benefit ranks by
+ * reclaimed bytes per byte moved (each valid byte is read and rewritten),
+ * taken from the wp_/used_capacity_ counters without walking extents, and
+ * leaves zones at or above keep_valid_pct valid alone, collecting them in
+ * gc_kept_zones_ for FinishKeptZones(). Ranking changes no zone state.
+ * Either way zones with hot readers sink in the queue.
+ * Called with io_zones_mtx held. */
+uint64_t ZonedBlockDevice::BuildGCQueue(const ZenFSGCOptions &gc_opts) {
+  uint64_t total_invalid = 0;
+  auto cool = [&](Zone *z, uint64_t key) -> uint64_t {
+    if (!gc_opts.hot_read_heat) return key;
+    double heat = (double)zone_io_.ReadHeat(z->start_);
+    key = (uint64_t)(key / (1.0 + heat / gc_opts.hot_read_heat));
+    return key ? key : 1;
+  };
+
+  while (!gc_queue_.empty()) {
+    delete gc_queue_.top();
+    gc_queue_.pop();
+  }
+  gc_kept_zones_.clear();
+
+  for (auto z : io_zones) {
+    if (z->open_for_write_) continue;
+
+    if (gc_opts.victim == ZENFS_GC_VICTIM_COST_BENEFIT) {
+      uint64_t written = z->wp_ - z->start_;
+      uint64_t valid = z->used_capacity_.load();
+      if (written == 0 || valid >= written) continue;
+      uint64_t invalid = written - valid;
+
+      if (valid * 100 >= written * gc_opts.keep_valid_pct) {
+        gc_kept_zones_.push_back(z);
+        continue;
+      }
+
+      uint64_t score = invalid * ZENFS_GC_CB_SCALE / (2 * valid + block_sz_);
+      gc_queue_.push(new GCVictimZone(z, cool(z, score)));
+      total_invalid += invalid;
+      continue;
+    }
+
+    uint64_t invalid_extent_length = 0;
+    for (auto ext_info : z->extent_info_) {
+      /*
+        Busy wait til Append request to the zone completed.
+        No need to check the condition in the loop
+        since zone is allocated to one file at each time.
+      */
+      while (z->is_append.load()) {
+      }
+      if (ext_info->valid_) continue;
+
+      uint64_t cur_length = (uint64_t)ext_info->length_;
+      uint64_t align = (uint64_t)(cur_length % block_sz_);
+      invalid_extent_length += cur_length + (align ? block_sz_ - align : 0);
+    }
+    //Insert into queue with sorting by its invalid ratio.
+    //Higher the invalid ratio, Higher the priority.
+    if (invalid_extent_length > 0) {
+      gc_queue_.push(new GCVictimZone(z, cool(z, invalid_extent_length)));
+      total_invalid += invalid_extent_length;
+    }
+  }
+  return total_invalid;
+}
+
 Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
                                      InternalKey smallest, InternalKey largest,
                                      int level) {
 
   Zone *allocated_zone = nullptr;
   unsigned int best_diff = LIFETIME_DIFF_NOT_GOOD;
+  ZenFSAllocPath path = ZENFS_ALLOC_NONE;
+  auto alloc_start = std::chrono::steady_clock::now();
+  ZenFSGCOptions gc_opts = GetGCOptions();
   Status s;
-  
+
   io_zones_mtx.lock();
   /* Make sure we are below the zone open limit */
-  {
-    std::unique_lock<std::mutex> lk(zone_resources_mtx_);
-    zone_resources_.wait(lk, [this] {
-      if (open_io_zones_.load() < max_nr_open_io_zones_) return true;
-      return false;
-    });
-  }
+  WaitForOpenIOZoneToken();
   
   /* Sort Zone by follows rules
    * (1) has more valid data
@@ -823,73 +1466,24 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
       active_io_zones_--;
     }
   }
-#ifndef LAZY
-  {
-    uint64_t free = GetFreeSpace();
+  if (gc_opts.mode == ZENFS_GC_EAGER) {
     size_t nr_zones = io_zones.size();
-    uint64_t total = (nr_zones * io_zones[0]->max_capacity_);
-    //fprintf(stderr, "total : %zu , free : %zu\n", total, free);
-    double free_ratio = (((double)free / total) * 100);
+    double free_ratio = GetFreePct();
 
-    bool trigger_zc = free_ratio <= 25.0f;
+    bool trigger_zc = free_ratio <= gc_opts.trigger_free_pct;
    
-    if (trigger_zc) {
-      uint64_t num_zone_to_reset;
-      if (free_ratio > 25.0f) {
-          num_zone_to_reset = nr_zones / 15;   
-      } else if (free_ratio > 20.0f) {
-          num_zone_to_reset = nr_zones / 10;       
-      } else {
-          num_zone_to_reset = nr_zones / 5;       
-      }
-      while (!gc_queue_.empty()){
-        auto a = gc_queue_.top();
-        delete a;
-        gc_queue_.pop();
-      }
-    for (auto z : io_zones) {
-        uint64_t valid_extent_length = 0;
-        uint64_t invalid_extent_length = 0;
-        std::vector<ZoneExtentInfo *> invalid_list;
-        std::vector<ZoneExtentInfo *> valid_list;
-        for(auto ext_info: z->extent_info_) {
-          
-          //    Busy wait til Append request to the zone completed.
-          //    No need to check the condition in the loop 
-          //    since zone is allocated to one file at each time.
-            
-            while(z->is_append.load()){ }
-            
-            if(ext_info->valid_) {
-                uint64_t cur_length = (uint64_t)ext_info->length_;
-                uint64_t align = (uint64_t)(cur_length % block_sz_);
-                uint64_t pad = 0;
-                if(align){
-                    pad = block_sz_ - align;
-                }
-                valid_extent_length += (cur_length + pad);
-                valid_list.push_back(ext_info);
-            }else {
-                uint64_t cur_length = (uint64_t)ext_info->length_;
-                uint64_t align = (uint64_t)(cur_length % block_sz_);
-                uint64_t pad = 0;
-                if(align){
-                    pad = block_sz_ - align;
-                }
-                invalid_extent_length += (cur_length + pad);
-                invalid_list.push_back(ext_info);
-            }
-        }
-        //Insert into queue with sorting by its invalid ratio. 
-        //Higher the invalid ratio, Higher the priority.
-        if (invalid_extent_length > 0 && !z->open_for_write_) {
-          gc_queue_.push(new GCVictimZone(z, invalid_extent_length));
-        }
-    }
+    if (trigger_zc && gc_opts.adaptive) {
+      /* Paced cleaning is left to the GC thread, this allocation goes on */
+      ScheduleBackgroundGC(gc_rate_.Plan(free_ratio, nr_zones, gc_opts,
+                                         GetWritePressure()));
+    } else if (trigger_zc) {
+      uint64_t num_zone_to_reset = gc_opts.ZonesToReset(free_ratio, nr_zones);
+      BuildGCQueue(gc_opts);
+   auto gc_start = std::chrono::steady_clock::now();
    ZoneCleaning(num_zone_to_reset);
+   metrics_.RecordInlineGC(MicrosSince(gc_start));
   }
  }
-#endif
 
   if (sst_to_zone_.empty()) {//ûsstzone
     if (active_io_zones_.load() < max_nr_active_io_zones_) {
@@ -897,6 +1491,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
         if ((!z->open_for_write_) && z->IsEmpty()) {
           z->lifetime_ = file_lifetime;
           allocated_zone = z;
+          path = ZENFS_ALLOC_NO_SST_EMPTY;
           active_io_zones_++;
           break;
         }
@@ -907,6 +1502,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
@@ -1007,6 +1603,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
             }
         if (!z->open_for_write_) {
           allocated_zone = z;
+          path = ZENFS_ALLOC_OVERLAP;
           alloc_inval_data = inval_data;
           break;
           }
@@ -1036,6 +1633,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     sst_zone_mtx_.unlock();
     //Allocate Zones with most the number of L0 files
     allocated_zone = AllocateMostL0Files(zone_list);
+    if (allocated_zone) path = ZENFS_ALLOC_L0_MAJORITY;
   }
 
   //Find the Empty Zone First
@@ -1045,6 +1643,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
        if ((!z->open_for_write_) && z->IsEmpty()) {
         z->lifetime_ = file_lifetime;
         allocated_zone = z;
+        path = ZENFS_ALLOC_EMPTY;
         active_io_zones_++;
         break;
        }
@@ -1056,6 +1655,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     LogZoneStats();
     return allocated_zone;
@@ -1064,12 +1664,14 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
   if (!allocated_zone) {
     SameLevelFileList(level, fno_list);
     allocated_zone = AllocateZoneWithSameLevelFiles(fno_list, smallest, largest);
+    if (allocated_zone) path = ZENFS_ALLOC_SAME_LEVEL;
   }
 
   if (allocated_zone) {
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
@@ -1080,6 +1682,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
       unsigned int diff = GetLifeTimeDiff(z->lifetime_, file_lifetime);
       if (diff <= best_diff) {
         allocated_zone = z;
+        path = ZENFS_ALLOC_LIFETIME;
         best_diff = diff;
       }
     }
@@ -1089,67 +1692,24 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
 
-#ifndef LAZY
-  if (!allocated_zone) {
-   while (!gc_queue_.empty()){
-      auto a = gc_queue_.top();
-      delete a;
-      gc_queue_.pop();
-   }
+  if (!allocated_zone && gc_opts.mode == ZENFS_GC_EAGER) {
   //Trigger GC for reclaim free space in the Device.
   //(Step 1) Classify all active zones by its invalid data ratio.
-    uint64_t total_invalid = 0;
-    for (auto z : io_zones) {
-        uint64_t valid_extent_length = 0;
-        uint64_t invalid_extent_length = 0;
-        std::vector<ZoneExtentInfo *> invalid_list;
-        std::vector<ZoneExtentInfo *> valid_list;
-        for(auto ext_info: z->extent_info_) {
-            /*
-              Busy wait til Append request to the zone completed.
-              No need to check the condition in the loop 
-              since zone is allocated to one file at each time.
-            */
-            while(z->is_append.load()){ }
-            
-            if(ext_info->valid_) {
-                uint64_t cur_length = (uint64_t)ext_info->length_;
-                uint64_t align = (uint64_t)(cur_length % block_sz_);
-                uint64_t pad = 0;
-                if(align){
-                    pad = block_sz_ - align;
-                }
-                valid_extent_length += (cur_length + pad);
-                valid_list.push_back(ext_info);
-            }else {
-                uint64_t cur_length = (uint64_t)ext_info->length_;
-                uint64_t align = (uint64_t)(cur_length % block_sz_);
-                uint64_t pad = 0;
-                if(align){
-                    pad = block_sz_ - align;
-                }
-                invalid_extent_length += (cur_length + pad);
-                total_invalid += invalid_extent_length;
-                invalid_list.push_back(ext_info);
-            }
-        }
-        //Insert into queue with sorting by its invalid ratio. 
-        //Higher the invalid ratio, Higher the priority.
-        if (invalid_extent_length > 0 && !z->open_for_write_) {
-          gc_queue_.push(new GCVictimZone(z, invalid_extent_length));
-        }
-    }
+  uint64_t total_invalid = BuildGCQueue(gc_opts);
   uint64_t num_zone_to_reset;
   if (total_invalid  < io_zones[0]->max_capacity_ ){
     num_zone_to_reset = 0;
   } else {
     num_zone_to_reset = RESERVED_ZONE_FOR_CLEANING;
   }
+  auto gc_start = std::chrono::steady_clock::now();
   ZoneCleaning(num_zone_to_reset);
+  metrics_.RecordInlineGC(MicrosSince(gc_start));
   }
 
   fno_list.clear();
@@ -1245,6 +1805,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
         }
         if (!z->open_for_write_) {
           allocated_zone = z;
+          path = ZENFS_ALLOC_AFTER_GC;
           alloc_inval_data = inval_data;
           break;
         }
@@ -1323,6 +1884,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     sst_zone_mtx_.unlock();
     //Allocate Zones with most the number of L0 files
     allocated_zone = AllocateMostL0Files(zone_list);
+    if (allocated_zone) path = ZENFS_ALLOC_AFTER_GC;
   }
   //Find the Empty Zone First
   if (!allocated_zone) {
@@ -1331,6 +1893,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
        if ((!z->open_for_write_) && z->IsEmpty()) {
         z->lifetime_ = file_lifetime;
         allocated_zone = z;
+        path = ZENFS_ALLOC_AFTER_GC;
         active_io_zones_++;
         break;
        }
@@ -1341,6 +1904,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
@@ -1348,12 +1912,14 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
   if (!allocated_zone && level != 100) {
     SameLevelFileList(level, fno_list);
     allocated_zone = AllocateZoneWithSameLevelFiles(fno_list, smallest, largest);
+    if (allocated_zone) path = ZENFS_ALLOC_AFTER_GC;
   }
 
   if (allocated_zone) {
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
@@ -1364,6 +1930,7 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
       unsigned int diff = GetLifeTimeDiff(z->lifetime_, file_lifetime);
       if (diff <= best_diff) {
         allocated_zone = z;
+        path = ZENFS_ALLOC_AFTER_GC;
         best_diff = diff;
       }
     }
@@ -1373,10 +1940,11 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
     assert(!allocated_zone->open_for_write_);
     allocated_zone->open_for_write_ = true;
     open_io_zones_++;
+    RecordAllocation(allocated_zone, path, level, alloc_start);
     io_zones_mtx.unlock();
     return allocated_zone;
   }
-#endif
+  RecordAllocation(allocated_zone, path, level, alloc_start);
   io_zones_mtx.unlock();
   LogZoneStats();
 
@@ -1386,29 +1954,111 @@ Zone* ZonedBlockDevice::AllocateZone(Env::WriteLifeTimeHint file_lifetime,
 std::string ZonedBlockDevice::GetFilename() { return filename_; }
 uint32_t ZonedBlockDevice::GetBlockSize() { return block_sz_; }
 
-Zone *ZonedBlockDevice::AllocateZoneForCleaning() {
+/* Relocation stream for an extent. Data that survived a GC pass is colder
+ * than fresh writes, so survivors are clustered by how cold their file is:
+ * hot (L0-L1, WAL and other short lived files), warm (L2-L3), cold (L4-L5)
+ * and coldest (deeper levels or extreme lifetime hint). */
+int ZonedBlockDevice::GCStreamFor(int level, Env::WriteLifeTimeHint lt,
+                                  uint32_t nr_streams) {
+  int stream;
+
+  if (level < 0 || level == 100) {
+    stream = (lt >= Env::WLTH_LONG) ? 2 : 0;
+  } else if (level <= 1) {
+    stream = 0;
+  } else if (level <= 3) {
+    stream = 1;
+  } else if (level <= 5) {
+    stream = 2;
+  } else {
+    stream = 3;
+  }
+  if (lt == Env::WLTH_EXTREME) stream = 3;
+
+  /* Fewer streams merge the coldest classes */
+  return std::min<int>(stream, (int)nr_streams - 1);
+}
+
+/* A full stream zone leaves the reserve pool and becomes an io zone */
+void ZonedBlockDevice::RetireGCStreamZone(Zone *z) {
+  reserve_pool_.Retire(z);
+  io_zones.push_back(z);
+  for (int i = 0; i < ZENFS_GC_STREAMS; i++)
+    if (gc_streams_[i] == z) gc_streams_[i] = nullptr;
+}
+
+/* Streams at or above nr_streams are no longer written. Finish their zones
+ * so they don't stay active and hand them to the io zones.
+ * Called with io_zones_mtx held. */
+void ZonedBlockDevice::CloseGCStreams(uint32_t nr_streams) {
+  for (int i = nr_streams; i < ZENFS_GC_STREAMS; i++) {
+    Zone *z = gc_streams_[i];
+    if (!z) continue;
+    if (!z->IsEmpty() && !z->IsFull() && z->Finish().ok()) active_io_zones_--;
+    RetireGCStreamZone(z);
+  }
+}
+
+bool ZonedBlockDevice::IsGCStreamZone(Zone *z) {
+  for (int i = 0; i < ZENFS_GC_STREAMS; i++)
+    if (gc_streams_[i] == z) return true;
+  return false;
+}
+
+/* Destination zone of a relocation stream. A stream keeps writing its zone
+ * across passes until it is full, then takes an empty zone from the reserve
+ * pool. Stream zones are held by the pool and not on io_zones, so file
+ * allocation never mixes fresh data into them. */
+Zone *ZonedBlockDevice::AllocateZoneForCleaning(int stream) {
 
   Zone *allocated_zone = nullptr;
   Status s;
 
   /* Make sure we are below the zone open limit */
-  {
-    std::unique_lock<std::mutex> lk(zone_resources_mtx_);
-    zone_resources_.wait(lk, [this] {
-      if (open_io_zones_.load() < max_nr_open_io_zones_) return true;
-      return false;
-    });
+  WaitForOpenIOZoneToken();
+
+  allocated_zone = gc_streams_[stream];
+  if (allocated_zone && allocated_zone->capacity_ == 0) {
+    RetireGCStreamZone(allocated_zone);
+    allocated_zone = nullptr;
   }
 
-  allocated_zone = reserved_zones[0];
+  if (!allocated_zone) {
+    allocated_zone = reserve_pool_.Acquire();
+
+    /* The pool ran dry, take an empty io zone rather than fail */
+    if (!allocated_zone) {
+      auto it = std::find_if(io_zones.begin(), io_zones.end(), [](Zone *z) {
+        return z->IsEmpty() && !z->open_for_write_;
+      });
+      if (it != io_zones.end()) {
+        allocated_zone = *it;
+        io_zones.erase(it);
+        reserve_pool_.Adopt(allocated_zone);
+      }
+    }
+
+    if (allocated_zone) {
+      gc_streams_[stream] = allocated_zone;
+    } else {
+      /* Nothing empty left, share another stream's zone */
+      for (int i = 0; !allocated_zone && i < ZENFS_GC_STREAMS; i++) {
+        if (gc_streams_[i] && gc_streams_[i]->capacity_ > 0)
+          allocated_zone = gc_streams_[i];
+      }
+    }
+  }
 
   if (!allocated_zone) {
-      printZoneStatus(reserved_zones);
+      std::vector<Zone *> reserve;
+      reserve_pool_.GetZones(&reserve);
+      printZoneStatus(reserve);
       fprintf(stderr, "Allocate Zone Failed While Running Zone Cleaning!\n");
       exit(1);
   }
   assert(!allocated_zone->open_for_write_);
   allocated_zone->open_for_write_ = true;
+  allocated_zone->write_source_ = ZENFS_WR_GC;
   open_io_zones_++;
 
   return allocated_zone;
@@ -1450,35 +2100,239 @@ void ZonedBlockDevice::printZoneStatus(const std::vector<Zone *>& zones){
     }
 }
 
+/* Pin the file owning ext_info for copying and take its extent read lock,
+ * false if the extent is no longer valid. A pinned file of any kind (table,
+ * WAL, MANIFEST) is not freed: ZoneFile teardown invalidates its extents
+ * under the extent write lock, then calls ReleaseFileForGC(), which waits
+ * for the pins. The pin is taken under gc_pins_mtx_, so it is either
+ * counted before that wait or sees the extent invalid. */
+bool ZonedBlockDevice::PinFileForGC(ZoneExtentInfo *ext_info) {
+  ZoneFile *zone_file = ext_info->zone_file_;
+  {
+    std::lock_guard<std::mutex> lk(gc_pins_mtx_);
+    if (!ext_info->valid_) return false;
+    gc_pins_[zone_file]++;
+  }
+  zone_file->ExtentReadLock();
+  return true;
+}
+
+void ZonedBlockDevice::UnpinFileForGC(ZoneFile *zone_file) {
+  std::lock_guard<std::mutex> lk(gc_pins_mtx_);
+  auto it = gc_pins_.find(zone_file);
+  assert(it != gc_pins_.end());
+  if (--it->second == 0) {
+    gc_pins_.erase(it);
+    gc_pins_cv_.notify_all();
+  }
+}
+
+/* Wait until GC no longer uses zone_file. Called by ZoneFile teardown
+ * after it invalidated all extents and before it frees the file, without
+ * the file's extent lock held. */
+void ZonedBlockDevice::ReleaseFileForGC(ZoneFile *zone_file) {
+  std::unique_lock<std::mutex> lk(gc_pins_mtx_);
+  gc_pins_cv_.wait(lk, [&] { return gc_pins_.count(zone_file) == 0; });
+}
+
+static bool ExtentStillValid(ZoneExtent *extent) {
+  for (const auto ex : extent->zone_->extent_info_) {
+    if (ex->extent_ == extent) return ex->valid_;
+  }
+  return false;
+}
+
+/* Replace the relocated extents of a file in one go. The copies were made
+ * under the extent read lock, the write lock is only taken for the swap so
+ * readers of the file stall for a list update rather than a zone copy. One
+ * UpdateExtents call means one metadata record per file.
+ * The pin keeps the file alive while the read lock is traded for the write
+ * lock, no other lock is held for that. Sources that were invalidated in
+ * between, because the file was deleted or rewritten, are checked under
+ * the write lock and their copies are invalidated. Their victim keeps its
+ * used capacity. Returns false if any copy was thrown away, the victim
+ * must not be reset then. */
+bool ZonedBlockDevice::CommitRelocatedExtents(
+    ZoneFile *zone_file,
+    std::map<ZoneExtent *, std::vector<ZoneExtent *>> &relocated) {
+  zone_file->ExtentReadUnlock();
+  zone_file->ExtentWriteLock();
+
+  std::vector<ZoneExtent *> replace_extents_;
+  std::set<ZoneExtent *> swapped;
+  bool changed = false;
+  for (auto ze : zone_file->GetExtentsList()) {
+    auto it = relocated.find(ze);
+    if (it != relocated.end() && ExtentStillValid(ze)) {
+      for (auto new_ze : it->second) {
+        replace_extents_.push_back(new_ze);
+      }
+      swapped.insert(ze);
+      changed = true;
+    } else {
+      replace_extents_.push_back(ze);
+    }
+  }
+  if (changed) zone_file->UpdateExtents(replace_extents_);
+
+  bool all = true;
+  for (auto &r : relocated) {
+    reloc_cache_.Drop(r.first);
+    if (swapped.count(r.first)) continue;
+    for (auto new_ze : r.second) {
+      new_ze->zone_->Invalidate(new_ze);
+      new_ze->zone_->used_capacity_ -= new_ze->length_;
+    }
+    r.first->zone_->used_capacity_ += r.first->length_;
+    all = false;
+  }
+  zone_file->ExtentWriteUnlock();
+  UnpinFileForGC(zone_file);
+  relocated.clear();
+  return all;
+}
+
+/* Zones BuildGCQueue() kept out of cleaning are finished when that wastes
+ * no more room than cleaning would reclaim. Each zone is counted as kept
+ * once until it is reset. Called with io_zones_mtx held. */
+void ZonedBlockDevice::FinishKeptZones(const ZenFSGCOptions &gc_opts) {
+  for (auto z : gc_kept_zones_) {
+    if (!z->gc_kept_) {
+      z->gc_kept_ = true;
+      metrics_.gc_zones_kept++;
+    }
+    uint64_t room = z->max_capacity_ * (100 - gc_opts.keep_valid_pct);
+    if (!z->open_for_write_ && !z->IsFull() && z->capacity_ * 100 <= room) {
+      if (z->Finish().ok()) active_io_zones_--;
+    }
+  }
+  gc_kept_zones_.clear();
+}
+
+/* Read the valid extents of one file in a victim, valid_extents[first] on,
+ * as one device batch of at most ZENFS_GC_READ_BATCH bytes. Every extent
+ * is read as whole blocks into its own pooled buffer and added to batch.
+ * Extents that got no buffer are left out. */
+void ZonedBlockDevice::ReadGCBatch(
+    const std::vector<ZoneExtentInfo *> &valid_extents, size_t first,
+    std::map<ZoneExtent *, ZonedDeviceRead> *batch) {
+  ZoneFile *zone_file = valid_extents[first]->zone_file_;
+  std::vector<ZonedDeviceRead> reads;
+  std::vector<ZoneExtent *> extents;
+  uint64_t bytes = 0;
+
+  for (size_t e = first; e < valid_extents.size() &&
+                         valid_extents[e]->zone_file_ == zone_file &&
+                         reads.size() < ZENFS_GC_READ_BATCH_EXTENTS;
+       e++) {
+    ZoneExtent *ext = valid_extents[e]->extent_;
+    size_t len = ext->length_;
+    if (len % block_sz_) len += block_sz_ - (len % block_sz_);
+    if (!reads.empty() && bytes + len > ZENFS_GC_READ_BATCH) break;
+    char *buf = read_buffers_->Get(len);
+    if (!buf) break;
+    reads.push_back({ext->start_, len, buf, 0, IOStatus::OK()});
+    extents.push_back(ext);
+    bytes += len;
+  }
+
+  IOStatus s = ZonedReadDevice(this, &reads);
+  for (size_t i = 0; i < reads.size(); i++) {
+    if (!s.ok()) reads[i].status = s;
+    (*batch)[extents[i]] = reads[i];
+  }
+}
+
+/* Free space of the io zones in percent. Called with io_zones_mtx held. */
+double ZonedBlockDevice::GetFreePct() {
+  uint64_t total = io_zones.size() * io_zones[0]->max_capacity_;
+  return ((double)GetFreeSpace() / total) * 100;
+}
+
+/* Ask the GC thread to reset nr_reset zones, replacing an older plan */
+void ZonedBlockDevice::ScheduleBackgroundGC(uint64_t nr_reset) {
+  {
+    std::lock_guard<std::mutex> lk(gc_thread_mtx_);
+    gc_zones_wanted_ = nr_reset;
+  }
+  gc_thread_cv_.notify_one();
+}
+
+/* Adaptive GC runs on this thread, never inline in AllocateZone. Every
+ * round cleans a single victim under io_zones_mtx, then waits on gc_rate_
+ * for the bytes it copied with no lock held. Allocations wait at most for
+ * one victim's copy and never for GC bandwidth, and a rate lowered by
+ * Plan() under write pressure only slows GC. Rounds go on until the
+ * planned zones are reset or free space is back above the trigger. An
+ * allocation that finds no zone at all still cleans inline, unpaced. */
+void ZonedBlockDevice::BackgroundGC() {
+  std::unique_lock<std::mutex> lk(gc_thread_mtx_);
+  while (true) {
+    gc_thread_cv_.wait(
+        lk, [this] { return gc_thread_stop_ || gc_zones_wanted_ > 0; });
+    if (gc_thread_stop_) break;
+    lk.unlock();
+
+    uint64_t paced = 0;
+    int reset = 0;
+    io_zones_mtx.lock();
+    ZenFSGCOptions gc_opts = GetGCOptions();
+    if (gc_opts.mode == ZENFS_GC_EAGER && gc_opts.adaptive &&
+        GetFreePct() <= gc_opts.trigger_free_pct) {
+      BuildGCQueue(gc_opts);
+      reset = ZoneCleaning(1, &paced);
+    }
+    io_zones_mtx.unlock();
+    if (paced) metrics_.gc_throttled_micros += gc_rate_.Request(paced);
+
+    lk.lock();
+    if (reset > 0 && gc_zones_wanted_ > 0)
+      gc_zones_wanted_--;
+    else
+      gc_zones_wanted_ = 0;
+  }
+}
+
 /*
  ZoneCleaning
  (1) Select zone with most invalid data.
  (2) Process until every invalid data gets cleaned from zone.
 */
-int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
+/* With paced set, the bytes copied are added to it (twice for hot victims)
+ * for the caller to wait on gc_rate_ after dropping the locks. Returns the
+ * number of zones reset. */
+int ZonedBlockDevice::ZoneCleaning(int nr_reset, uint64_t *paced) {
 
     zone_cleaning_mtx.lock();
     int reseted = 0;
+    FinishKeptZones(GetGCOptions());
 
     if (nr_reset == 0){
-       for (auto it = reserved_zones.begin(); it != reserved_zones.end(); ){
-          io_zones.push_back(*it);
-          reserved_zones.erase(it);
-          break;
-       }
+      //Nothing worth cleaning, lend one reserved zone to file allocation.
+      Zone* lent = reserve_pool_.Lend();
+      if (lent) io_zones.push_back(lent);
       zone_cleaning_mtx.unlock();
       return 0;
     }
 
-#ifdef EXPERIMENT
+    ZenFSZoneIO::GCScope gc_io;
+    ZenFSGCOptions gc_opts = GetGCOptions();
+    bool log_copied = gc_opts.log_copied;
     uint64_t copied_data = 0;
-#endif
+    metrics_.gc_runs++;
     Zone* allocated_zone = nullptr;
     while(!gc_queue_.empty()){
         //Process until every invalid data gets cleaned from zone.
         Zone* cur_victim = gc_queue_.top()->get_zone_ptr();
         int victim_zone_id = cur_victim->zone_id_;
         assert(cur_victim);
+        uint64_t victim_written = cur_victim->wp_ - cur_victim->start_;
+        uint64_t victim_copied_from = copied_data;
+        //Copies out of a zone with hot readers go at half the GC rate.
+        bool hot_victim =
+            gc_opts.hot_read_heat &&
+            zone_io_.ReadHeat(cur_victim->start_) >= gc_opts.hot_read_heat;
+        if (hot_victim) metrics_.gc_hot_victims++;
 
         //PrintVictimInformation(cur_victim, true);
 
@@ -1492,15 +2346,38 @@ int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
            }
         }
         
+        //Group the extents by their file, so every file gets its extent list
+        //swapped (and one metadata record written) once per victim zone.
+        std::stable_sort(valid_extents_info.begin(), valid_extents_info.end(),
+                         [](ZoneExtentInfo* a, ZoneExtentInfo* b) {
+                           return std::less<ZoneFile*>()(a->zone_file_, b->zone_file_);
+                         });
+        ZoneFile* locked_file = nullptr;
+        std::map<ZoneExtent *, std::vector<ZoneExtent *>> relocated;
+        std::map<ZoneExtent *, ZonedDeviceRead> read_ahead;
+        bool victim_failed = false;
+
         //(1) Find which ZoneFile current extents belongs to.
         //(2) Check Each lifetime of file to which each extent belongs to.    
-        for(ZoneExtentInfo* ext_info : valid_extents_info) {
+        for (size_t e = 0; e < valid_extents_info.size(); e++) {
+            ZoneExtentInfo* ext_info = valid_extents_info[e];
             //Extract All the inforamtion from Extents inforamtion structure
             assert(cur_victim == ext_info->extent_->zone_);
             ZoneExtent* zone_extent = ext_info->extent_;
             ZoneFile* zone_file = ext_info->zone_file_;
             
-            zone_file->ExtentWriteLock();
+            if (zone_file != locked_file) {
+              if (locked_file && !CommitRelocatedExtents(locked_file, relocated))
+                victim_failed = true;
+              locked_file = nullptr;
+              if (victim_failed || !PinFileForGC(ext_info)) {
+                //The extent was invalidated, the file is being deleted or
+                //rewritten and may still be counted in the victim.
+                victim_failed = true;
+                break;
+              }
+              locked_file = zone_file;
+            }
 
             assert(zone_extent && zone_file);
 
@@ -1516,32 +2393,48 @@ int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
               pad_sz = block_sz_ - align; 
             }
 
-            char* buff;
-            int ret = posix_memalign((void**)&buff, GetBlockSize(), data_size);
-
-            if(ret) {
-              fprintf(stderr, "Zone Cleaning : failed allocating alignment write buffer\n");
+            //Read whole blocks, the padding was written along with the extent
+            //and this keeps direct reads on the zero-copy path. The file's
+            //next extents in this victim are read in the same batch.
+            if (!read_ahead.count(zone_extent))
+              ReadGCBatch(valid_extents_info, e, &read_ahead);
+            auto ra = read_ahead.find(zone_extent);
+            if (ra == read_ahead.end()) {
+              Error(logger_, "Zone Cleaning : failed allocating read buffer");
+              victim_failed = true;
+              break;
             }
-
-            int f = GetReadFD();
-            int f_direct = GetReadDirectFD();
-            ssize_t r = 0;
+            char* buff = ra->second.dst;
+            bool read_ok = ra->second.status.ok() &&
+                           ra->second.done >= valid_size;
+            read_ahead.erase(ra);
             uint64_t r_off = zone_extent->start_;
 
-            r = pread(f, buff, zone_extent->length_, r_off);
-            
-            if (r < 0) {
-              r = pread(f_direct, buff, zone_extent->length_, r_off);
+            if (paced) *paced += hot_victim ? 2 * data_size : data_size;
+
+            if (!read_ok) {
+              Error(logger_,
+                    "Zone Cleaning : failed reading %u bytes at %lu of zone %d",
+                    valid_size, r_off, victim_zone_id);
+              read_buffers_->Put(buff, data_size);
+              victim_failed = true;
+              break;
             }
-            assert(r >= 0);
             
             if (pad_sz > 0) {
               memset((char*)buff + valid_size, 0x0, pad_sz); 
             }
-
-            //allocate Zone and write contents.
-            allocated_zone = AllocateZoneForCleaning();
+            //Readers still mapped onto the victim get this copy until the
+            //file's extents are swapped.
+            reloc_cache_.Insert(zone_extent, buff, valid_size);
+
+            //allocate Zone and write contents, separated by how cold the
+            //extent's file is.
+            int stream = GCStreamFor(ext_info->level_, ext_info->lt_,
+                                     gc_opts.streams);
+            allocated_zone = AllocateZoneForCleaning(stream);
             assert(allocated_zone);
+            allocated_zone->write_level_ = zone_file->level_;
 
             //Copy contents to new zone.
             {
@@ -1553,14 +2446,16 @@ int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
 
                 while (left) { 
                     assert(allocated_zone);                   
+                    //A stream zone becomes active with its first write
+                    if (allocated_zone->IsEmpty()) active_io_zones_++;
                     if(left <= allocated_zone->capacity_){
 
                     //There'are enough room for write original extent
                         s = allocated_zone->Append((char*)buff + offset, left);
-#ifdef EXPERIMENT
                         copied_data += (uint64_t)left;
-#endif
+                        metrics_.gc_bytes_copied += left;
                         allocated_zone->used_capacity_ += left;
+                        if (allocated_zone->capacity_ == 0) active_io_zones_--;
 
                         ZoneExtent * new_extent = new ZoneExtent((allocated_zone->wp_ - left), /*Extent length*/left-pad_sz, allocated_zone);
                         ZoneExtentInfo * new_extent_info = new ZoneExtentInfo(new_extent, zone_file ,true, left-pad_sz, new_extent->start_, allocated_zone, zone_file->GetFilename(), zone_file->GetWriteLifeTimeHint(), zone_file->level_);
@@ -1589,9 +2484,8 @@ int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
                         wr_size = allocated_zone->capacity_;
                         s = allocated_zone->Append((char*)buff + offset, wr_size);
                         assert(s.ok()); 
-#ifdef EXPERIMENT
                         copied_data += (uint64_t)wr_size;
-#endif
+                        metrics_.gc_bytes_copied += wr_size;
                         allocated_zone->used_capacity_ += wr_size;
 
                         left -= wr_size;
@@ -1625,103 +2519,62 @@ int ZonedBlockDevice::ZoneCleaning(int nr_reset) {
                         allocated_zone->Finish();
                         active_io_zones_--;
     
-                        for (auto it = reserved_zones.begin(); it != reserved_zones.end(); ){
-                          Zone * zz = (*it);
-                          if (allocated_zone == zz){
-                             io_zones.push_back(*it);
-                             reserved_zones.erase(it);
-                             break;
-                          }
-                          ++it;
-                        }
+                        RetireGCStreamZone(allocated_zone);
                         //newly allocate new zone for write
-                        allocated_zone = AllocateZoneForCleaning();
+                        allocated_zone = AllocateZoneForCleaning(stream);
                         assert(allocated_zone);
+                        allocated_zone->write_level_ = zone_file->level_;
                     }
                 }//end of while.
            
                 assert(new_extent_length == valid_size);
                 assert(cur_victim->used_capacity_ >= zone_extent->length_); 
                 cur_victim->used_capacity_ -= zone_extent->length_; 
-                //update extent information of the file.
-                //Replace origin extent information with newly made extent list.
-                std::vector<ZoneExtent *> origin_extents_ = zone_file->GetExtentsList();
-                std::vector<ZoneExtent *> replace_extents_;
-
-                for (auto ze : origin_extents_) {
-                  if (zone_extent == ze) {
-                    for (auto new_ze : new_zone_extents) {
-                      replace_extents_.push_back(new_ze);
-                    }
-                  } else {
-                    replace_extents_.push_back(ze);
-                  }
-                }
-                zone_file->UpdateExtents(replace_extents_);
-                zone_file->ExtentWriteUnlock();
+                relocated[zone_extent] = new_zone_extents;
             }            
-            free(buff);
+            read_buffers_->Put(buff, data_size);
+        }
+        //Read ahead but not copied, the pass stopped early
+        for (auto &ra : read_ahead)
+          read_buffers_->Put(ra.second.dst, ra.second.length);
+        if (locked_file && !CommitRelocatedExtents(locked_file, relocated))
+          victim_failed = true;
+        if (victim_failed) {
+          //Extents that were not copied still live in the victim, keep it
+          //and end the pass. What was relocated so far is committed.
+          gc_queue_.pop();
+          break;
         }
         assert(!cur_victim->open_for_write_);
         cur_victim->used_capacity_.store(0);
         cur_victim->Reset();
+        victim_copied_from = copied_data - victim_copied_from;
+        if (victim_written > victim_copied_from)
+          metrics_.gc_bytes_reclaimed += victim_written - victim_copied_from;
         active_io_zones_--;
         reseted++;
         for (auto it = io_zones.begin(); it != io_zones.end(); it++){
           if ((*it)->zone_id_ == cur_victim->zone_id_) {
-            if (reserved_zones.size() < RESERVED_ZONE_FOR_CLEANING){
-              io_zones.erase(it);
-              reserved_zones.push_back(cur_victim);
-            }
+            if (reserve_pool_.Release(cur_victim)) io_zones.erase(it);
             break;
           }
         }
         gc_queue_.pop();
         if (reseted >= nr_reset) break;
     }
-#ifdef EXPERIMENT
-    fprintf(stdout, "Total Copied Data in ZC : %lu\n", copied_data);
-#endif
-
-    for ( auto it = reserved_zones.begin(); it !=reserved_zones.end(); ){
-        if ( !((*it)->IsEmpty()) || ((*it)->IsUsed())) {
-            io_zones.push_back(*it);
-            reserved_zones.erase(it);
-        } else {
-            ++it;
-        }
+    if (log_copied) {
+      fprintf(stdout, "Total Copied Data in ZC : %lu\n", copied_data);
     }
-    if (reserved_zones.size() < RESERVED_ZONE_FOR_CLEANING) {
-      for ( auto it = io_zones.begin(); it !=io_zones.end(); ){
-       if ( ((*it)->IsEmpty()) && !((*it)->open_for_write_)) {
-            reserved_zones.push_back(*it);
-            io_zones.erase(it);
-        } else {
-            ++it;
-        }
 
-       if(reserved_zones.size() == RESERVED_ZONE_FOR_CLEANING) 
-         break;
-      }
-    }
-
-    if (reserved_zones.size() > RESERVED_ZONE_FOR_CLEANING) {
-
-      for ( auto it = reserved_zones.begin(); it !=reserved_zones.end(); ){
-        if ( reserved_zones.size() != RESERVED_ZONE_FOR_CLEANING) {
-            assert((*it)->IsEmpty() && !((*it)->open_for_write_));
-            io_zones.push_back(*it);
-            reserved_zones.erase(it);
-        } else {
-            ++it;
-        }
-      }
-    }
-    for (auto it = reserved_zones.begin(); it != reserved_zones.end(); it++){
-        (*it)->used_capacity_.store(0);
+    //Full stream zones go to the io zones, partially written ones stay
+    //held for the next pass. Then resize the free reserve to the demand.
+    for (int i = 0; i < ZENFS_GC_STREAMS; i++) {
+      if (gc_streams_[i] && gc_streams_[i]->capacity_ == 0)
+        RetireGCStreamZone(gc_streams_[i]);
     }
+    reserve_pool_.EndPass(&io_zones);
     zone_cleaning_mtx.unlock();
-    return 1;
+    return reseted;
 }//ZoneCleaning();
 }  // namespace ROCKSDB_NAMESPACE
 
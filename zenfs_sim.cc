@@ -0,0 +1,345 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+/* Offline placement and GC benchmark.
+ *
+ * Replays a file lifecycle trace against a ZonedBlockDevice on top of a
+ * simulated zoned device and reports write amplification, GC traffic,
+ * resets and allocation latency. Trace lines:
+ *
+ *   create <fno> <level> <lifetime> <smallest> <largest>
+ *   write <fno> <bytes>
+ *   close <fno>
+ *   delete <fno>
+ *
+ * level is 100 for non-SST files (WAL, MANIFEST), lifetime is the
+ * Env::WriteLifeTimeHint value and keys are hex user keys, "-" for an empty
+ * key. Lines starting with '#' are ignored.
+ *
+ * --lifecycle_trace replays a binary trace captured with
+ * DBImpl::StartZenFSTrace() instead. --gc_sweep replays the same trace
+ * once per GC configuration to compare policies side by side.
+ */
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD) && \
+    defined(GFLAGS)
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "db/dbformat.h"
+#include "io_zenfs.h"
+#include "gc_options_zenfs.h"
+#include "lifecycle_trace_zenfs.h"
+#include "metrics_zenfs.h"
+#include "monitoring/histogram.h"
+#include "rocksdb/convenience.h"
+#include "rocksdb/env.h"
+#include "util/gflags_compat.h"
+#include "zbd_backend.h"
+#include "zbd_zenfs.h"
+
+using GFLAGS_NAMESPACE::ParseCommandLineFlags;
+using GFLAGS_NAMESPACE::SetUsageMessage;
+
+DEFINE_string(trace, "", "File lifecycle trace to replay");
+DEFINE_string(lifecycle_trace, "",
+              "Binary trace from StartZenFSTrace to replay");
+DEFINE_string(policy, "default", "Label for this run in the report");
+DEFINE_string(gc_options, "",
+              "zenfs_gc_* options for every run, e.g. "
+              "\"zenfs_gc_mode=lazy;zenfs_gc_trigger_free_pct=30\"");
+DEFINE_string(gc_sweep, "",
+              "'|' separated GC configurations to compare, one run each, "
+              "e.g. \"zenfs_gc_mode=lazy|zenfs_gc_trigger_free_pct=15\"");
+DEFINE_string(image, "", "Back the simulated device with this file, "
+                         "memory if empty");
+DEFINE_bool(keep_data, false,
+            "Keep written data in memory when there is no image, reads "
+            "return zeroes otherwise. Needs memory for every live byte");
+DEFINE_string(log, "zenfs_sim.log", "ZenFS info log");
+DEFINE_uint32(zones, 256, "Number of zones");
+DEFINE_uint64(zone_size, 256 << 20, "Zone size in bytes");
+DEFINE_uint64(zone_capacity, 0, "Zone capacity in bytes, zone size if 0");
+DEFINE_uint32(block_size, 4096, "Device block size");
+DEFINE_uint32(max_active, 14, "Max active zones, 0 for no limit");
+DEFINE_uint32(max_open, 14, "Max open zones, 0 for no limit");
+DEFINE_uint64(write_chunk, 1 << 20, "Largest single append");
+
+namespace ROCKSDB_NAMESPACE {
+
+struct SimFile {
+  ZoneFile *zone_file;
+  uint64_t written;
+};
+
+/* Trace keys are hex, "-" for an empty key. Anything that doesn't decode
+ * is taken literally. */
+static InternalKey SimKey(const std::string &hex) {
+  std::string key;
+  if (hex != "-" && !Slice(hex).DecodeHex(&key)) key = hex;
+  return InternalKey(Slice(key), kMaxSequenceNumber, kTypeValue);
+}
+
+static int ReplayTrace(ZonedBlockDevice *zbd, std::istream &in,
+                       uint64_t *host_bytes, uint64_t *events) {
+  std::map<uint64_t, SimFile> files;
+  uint32_t block_sz = zbd->GetBlockSize();
+  size_t chunk = FLAGS_write_chunk - (FLAGS_write_chunk % block_sz);
+  char *buf = nullptr;
+  std::string line;
+  uint64_t lineno = 0;
+
+  if (chunk == 0 || posix_memalign((void **)&buf, block_sz, chunk)) {
+    fprintf(stderr, "Failed to allocate write buffer\n");
+    return 1;
+  }
+  memset(buf, 0xA5, chunk);
+
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    std::string op;
+    uint64_t fno;
+
+    lineno++;
+    if (!(ls >> op) || op[0] == '#') continue;
+    if (!(ls >> fno)) {
+      fprintf(stderr, "Bad trace line %" PRIu64 ": %s\n", lineno, line.c_str());
+      free(buf);
+      return 1;
+    }
+    (*events)++;
+
+    if (op == "create") {
+      int level, lifetime;
+      std::string smallest, largest;
+      ls >> level >> lifetime >> smallest >> largest;
+      ZoneFile *zf = new ZoneFile(zbd, std::to_string(fno) + ".sst", fno);
+      zf->SetWriteLifeTimeHint((Env::WriteLifeTimeHint)lifetime);
+      zf->level_ = level;
+      zf->is_sst_ = (level != 100);
+      zf->fno_ = fno;
+      zf->smallest_ = SimKey(smallest);
+      zf->largest_ = SimKey(largest);
+      files[fno] = {zf, 0};
+    } else if (op == "write") {
+      uint64_t bytes;
+      auto it = files.find(fno);
+      if (!(ls >> bytes) || it == files.end()) continue;
+      while (bytes) {
+        size_t valid = std::min<uint64_t>(bytes, chunk);
+        size_t len = valid;
+        if (len % block_sz) len += block_sz - (len % block_sz);
+        IOStatus s = it->second.zone_file->Append(buf, len, valid);
+        if (!s.ok()) {
+          fprintf(stderr, "Append failed at line %" PRIu64 ": %s\n", lineno,
+                  s.ToString().c_str());
+          free(buf);
+          return 1;
+        }
+        it->second.written += valid;
+        *host_bytes += valid;
+        bytes -= valid;
+      }
+    } else if (op == "close") {
+      auto it = files.find(fno);
+      if (it != files.end()) it->second.zone_file->CloseWR();
+    } else if (op == "delete") {
+      auto it = files.find(fno);
+      if (it == files.end()) continue;
+      delete it->second.zone_file;
+      files.erase(it);
+    }
+  }
+
+  for (auto &f : files) delete f.second.zone_file;
+  free(buf);
+  return 0;
+}
+
+static void Report(ZonedBlockDevice *zbd, const std::string &label,
+                   uint64_t host_bytes, uint64_t events, uint64_t micros) {
+  ZenFSMetrics *m = zbd->GetMetrics();
+  HistogramImpl alloc;
+  std::string detail;
+  uint64_t device = 0;
+
+  for (uint32_t i = 0; i < ZENFS_WR_SOURCE_NUM; i++)
+    device += m->write_bytes[i].load();
+  for (uint32_t i = 0; i < ZENFS_ALLOC_PATH_NUM; i++)
+    alloc.Merge(m->alloc_latency[i]);
+
+  printf("policy %s events %" PRIu64 " runtime_s %.1f\n", label.c_str(),
+         events, micros / 1000000.0);
+  printf("  wa %.3f host_mb %" PRIu64 " device_mb %" PRIu64
+         " gc_mb %" PRIu64 " gc_runs %" PRIu64 " resets %" PRIu64
+         " finishes %" PRIu64 "\n",
+         host_bytes ? (double)device / host_bytes : 0.0, host_bytes >> 20,
+         device >> 20, m->gc_bytes_copied.load() >> 20, m->gc_runs.load(),
+         m->resets.load(), m->finishes.load());
+  printf("  alloc_us count %" PRIu64 " P50 %.2f P99 %.2f MAX %.2f"
+         " waits %" PRIu64 "\n",
+         alloc.num(), alloc.Median(), alloc.Percentile(99), alloc.max(),
+         m->alloc_waits.load());
+  printf("  gc reclaimed_mb %" PRIu64 " reclaimed_per_copied %.3f"
+         " zones_kept %" PRIu64 "\n",
+         m->gc_bytes_reclaimed.load() >> 20,
+         m->gc_bytes_copied.load()
+             ? (double)m->gc_bytes_reclaimed.load() / m->gc_bytes_copied.load()
+             : 0.0,
+         m->gc_zones_kept.load());
+
+  m->HistogramsToString(&detail);
+  detail.append("** ZenFS write amplification **\n");
+  m->WriteAmpToString(&detail);
+  printf("%s", detail.c_str());
+}
+
+static Status LoadLifecycleTrace(const std::string &path, std::string *out) {
+  std::string data, line;
+  Status s = ReadFileToString(Env::Default(), path, &data);
+  if (!s.ok()) return s;
+
+  Slice in(data), record;
+  if (!ZenFSLifecycleTracer::NextRecord(&in, &record) ||
+      !ZenFSLifecycleTracer::IsHeader(record))
+    return Status::Corruption("Not a ZenFS lifecycle trace", path);
+
+  while (ZenFSLifecycleTracer::NextRecord(&in, &record)) {
+    if (ZenFSLifecycleTracer::DecodeToText(record, &line)) {
+      out->append(line);
+      out->append("\n");
+    }
+  }
+  /* A trace cut short by a crash ends in a partial record, keep the rest */
+  return Status::OK();
+}
+
+static Status LoadTrace(std::string *out) {
+  if (!FLAGS_lifecycle_trace.empty())
+    return LoadLifecycleTrace(FLAGS_lifecycle_trace, out);
+
+  std::ifstream f(FLAGS_trace);
+  if (!f.is_open()) return Status::IOError("Failed to open", FLAGS_trace);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  *out = ss.str();
+  return Status::OK();
+}
+
+/* Replay the trace on a fresh simulated device with the given GC options */
+static int RunOne(const std::string &trace, const std::string &label,
+                  const std::string &gc_options,
+                  std::shared_ptr<Logger> logger) {
+  std::unordered_map<std::string, std::string> opts;
+  Status s = StringToMap(gc_options, &opts);
+  if (!s.ok()) {
+    fprintf(stderr, "Bad GC options '%s': %s\n", gc_options.c_str(),
+            s.ToString().c_str());
+    return 1;
+  }
+
+  uint64_t cap = FLAGS_zone_capacity ? FLAGS_zone_capacity : FLAGS_zone_size;
+  ZbdBackend *backend =
+      new SimZbdBackend(FLAGS_zones, FLAGS_zone_size, cap, FLAGS_block_size,
+                        FLAGS_max_active, FLAGS_max_open, FLAGS_image,
+                        FLAGS_keep_data);
+  std::unique_ptr<ZonedBlockDevice> zbd(new ZonedBlockDevice(backend, logger));
+
+  IOStatus ios = zbd->Open(false);
+  if (!ios.ok()) {
+    fprintf(stderr, "Failed to open simulated device: %s\n",
+            ios.ToString().c_str());
+    return 1;
+  }
+  s = zbd->SetGCOptions(opts);
+  if (!s.ok()) {
+    fprintf(stderr, "Bad GC options '%s': %s\n", gc_options.c_str(),
+            s.ToString().c_str());
+    return 1;
+  }
+
+  std::istringstream in(trace);
+  uint64_t host_bytes = 0;
+  uint64_t events = 0;
+  auto start = std::chrono::steady_clock::now();
+  int ret = ReplayTrace(zbd.get(), in, &host_bytes, &events);
+  uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+  printf("gc %s\n", zbd->GetGCOptions().ToString().c_str());
+  Report(zbd.get(), label, host_bytes, events, micros);
+  return ret;
+}
+
+static int Run() {
+  std::shared_ptr<Logger> logger;
+  Status s = Env::Default()->NewLogger(FLAGS_log, &logger);
+  if (!s.ok()) {
+    fprintf(stderr, "Failed to open log: %s\n", s.ToString().c_str());
+    return 1;
+  }
+
+  std::string trace;
+  s = LoadTrace(&trace);
+  if (!s.ok()) {
+    fprintf(stderr, "Failed to load trace: %s\n", s.ToString().c_str());
+    return 1;
+  }
+
+  if (FLAGS_gc_sweep.empty())
+    return RunOne(trace, FLAGS_policy, FLAGS_gc_options, logger);
+
+  /* One run per '|' separated GC configuration, labelled by the config */
+  int ret = 0;
+  std::stringstream sweep(FLAGS_gc_sweep);
+  std::string config;
+  while (std::getline(sweep, config, '|')) {
+    if (config.empty()) continue;
+    std::string gc_options = FLAGS_gc_options;
+    if (!gc_options.empty()) gc_options.append(";");
+    gc_options.append(config);
+    ret |= RunOne(trace, config, gc_options, logger);
+  }
+  return ret;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+int main(int argc, char **argv) {
+  SetUsageMessage(std::string("\nUSAGE:\n") + std::string(argv[0]) +
+                  " --trace=<file> | --lifecycle_trace=<file> [--policy=<label>]"
+                  " [device options]");
+  ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_trace.empty() && FLAGS_lifecycle_trace.empty()) {
+    fprintf(stderr, "--trace or --lifecycle_trace is required\n");
+    return 1;
+  }
+  return ROCKSDB_NAMESPACE::Run();
+}
+
+#else
+
+#include <stdio.h>
+
+int main() {
+  fprintf(stderr, "zenfs_sim needs LIBZBD and GFLAGS\n");
+  return 1;
+}
+
+#endif
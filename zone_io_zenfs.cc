@@ -0,0 +1,261 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include "zone_io_zenfs.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace ROCKSDB_NAMESPACE {
+
+static thread_local ZenFSPerfContext zenfs_perf_context;
+static thread_local bool zenfs_in_gc = false;
+
+ZenFSPerfContext *get_zenfs_perf_context() { return &zenfs_perf_context; }
+
+std::string ZenFSPerfContext::ToString() const {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "zenfs_read_nanos = %" PRIu64 ", zenfs_read_count = %" PRIu64
+           ", zenfs_read_bytes = %" PRIu64 ", zenfs_write_nanos = %" PRIu64
+           ", zenfs_write_count = %" PRIu64 ", zenfs_write_bytes = %" PRIu64,
+           read_nanos, read_count, read_bytes, write_nanos, write_count,
+           write_bytes);
+  return buf;
+}
+
+const char *ZenFSZoneOpName(uint32_t op) {
+  switch (op) {
+    case ZENFS_ZOP_READ:
+      return "read";
+    case ZENFS_ZOP_APPEND:
+      return "append";
+    case ZENFS_ZOP_RESET:
+      return "reset";
+    case ZENFS_ZOP_FINISH:
+      return "finish";
+    case ZENFS_ZOP_GC_COPY:
+      return "gc-copy";
+    default:
+      return "unknown";
+  }
+}
+
+ZenFSZoneIO::Scope::Scope(ZenFSZoneIO *io, uint64_t dev_off, ZenFSZoneOp op,
+                          uint64_t bytes)
+    : io_(io),
+      zone_(0),
+      op_(op),
+      bytes_(bytes),
+      start_(std::chrono::steady_clock::now()) {
+  if (zenfs_in_gc && (op == ZENFS_ZOP_READ || op == ZENFS_ZOP_APPEND))
+    op_ = ZENFS_ZOP_GC_COPY;
+  if (io_->zone_sz_) zone_ = (uint32_t)(dev_off / io_->zone_sz_);
+  io_->Begin(zone_, op_);
+}
+
+ZenFSZoneIO::Scope::~Scope() {
+  uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start_)
+                       .count();
+  io_->End(zone_, op_, nanos / 1000);
+
+  ZenFSPerfContext *ctx = &zenfs_perf_context;
+  if (op_ == ZENFS_ZOP_READ) {
+    ctx->read_nanos += nanos;
+    ctx->read_count++;
+    ctx->read_bytes += bytes_;
+  } else if (op_ == ZENFS_ZOP_APPEND) {
+    ctx->write_nanos += nanos;
+    ctx->write_count++;
+    ctx->write_bytes += bytes_;
+  }
+}
+
+ZenFSZoneIO::GCScope::GCScope() : prev_(zenfs_in_gc) { zenfs_in_gc = true; }
+
+ZenFSZoneIO::GCScope::~GCScope() { zenfs_in_gc = prev_; }
+
+ZenFSZoneIO::ZenFSZoneIO() : nr_zones_(0), zone_sz_(0) {
+  for (uint32_t i = 0; i < ZENFS_ZOP_NUM; i++) inflight_[i].store(0);
+}
+
+void ZenFSZoneIO::Clear(OpStats *s) {
+  for (uint32_t b = 0; b < ZENFS_ZONE_LAT_BUCKETS; b++) s->buckets[b].store(0);
+  s->count.store(0);
+  s->micros.store(0);
+  s->max_micros.store(0);
+  s->inflight.store(0);
+}
+
+void ZenFSZoneIO::Init(uint32_t nr_zones, uint64_t zone_sz) {
+  zones_.reset(new ZoneStats[nr_zones]);
+  for (uint32_t z = 0; z < nr_zones; z++) {
+    for (uint32_t op = 0; op < ZENFS_ZOP_NUM; op++) Clear(&zones_[z].ops[op]);
+    zones_[z].heat.store(0);
+    zones_[z].heat_epoch.store(0);
+  }
+  zone_sz_ = zone_sz;
+  nr_zones_ = nr_zones;
+}
+
+ZenFSZoneIO::OpStats *ZenFSZoneIO::Get(uint32_t zone, ZenFSZoneOp op) {
+  if (zone >= nr_zones_) return nullptr;
+  return &zones_[zone].ops[op];
+}
+
+void ZenFSZoneIO::Begin(uint32_t zone, ZenFSZoneOp op) {
+  inflight_[op].fetch_add(1, std::memory_order_relaxed);
+  OpStats *s = Get(zone, op);
+  if (s) s->inflight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ZenFSZoneIO::End(uint32_t zone, ZenFSZoneOp op, uint64_t micros) {
+  inflight_[op].fetch_sub(1, std::memory_order_relaxed);
+  OpStats *s = Get(zone, op);
+  if (!s) return;
+
+  uint32_t b = 0;
+  while (b < ZENFS_ZONE_LAT_BUCKETS - 1 && (micros >> b)) b++;
+  s->inflight.fetch_sub(1, std::memory_order_relaxed);
+  s->buckets[b].fetch_add(1, std::memory_order_relaxed);
+  s->count.fetch_add(1, std::memory_order_relaxed);
+  s->micros.fetch_add(micros, std::memory_order_relaxed);
+  uint64_t max = s->max_micros.load(std::memory_order_relaxed);
+  while (micros > max &&
+         !s->max_micros.compare_exchange_weak(max, micros,
+                                              std::memory_order_relaxed)) {
+  }
+
+  if (op == ZENFS_ZOP_READ) {
+    Decay(&zones_[zone]);
+    zones_[zone].heat.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static uint32_t HeatEpoch() {
+  return (uint32_t)(std::chrono::duration_cast<std::chrono::seconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count() /
+                    ZENFS_READ_HEAT_HALF_LIFE_S);
+}
+
+/* Halve once per elapsed epoch. Racing readers may lose a few increments
+ * or decay twice, heat only has to rank zones. */
+uint64_t ZenFSZoneIO::Decay(ZoneStats *zs) {
+  uint32_t now = HeatEpoch();
+  uint32_t then = zs->heat_epoch.load(std::memory_order_relaxed);
+  if (now != then &&
+      zs->heat_epoch.compare_exchange_strong(then, now,
+                                             std::memory_order_relaxed)) {
+    uint32_t shift = now - then;
+    uint64_t h = zs->heat.load(std::memory_order_relaxed);
+    zs->heat.store(shift >= 64 ? 0 : h >> shift, std::memory_order_relaxed);
+  }
+  return zs->heat.load(std::memory_order_relaxed);
+}
+
+uint64_t ZenFSZoneIO::ReadHeat(uint64_t dev_off) {
+  if (zone_sz_ == 0) return 0;
+  uint64_t zone = dev_off / zone_sz_;
+  if (zone >= nr_zones_) return 0;
+  return Decay(&zones_[zone]);
+}
+
+void ZenFSZoneIO::ClearReadHeat(uint64_t dev_off) {
+  if (zone_sz_ == 0) return;
+  uint64_t zone = dev_off / zone_sz_;
+  if (zone >= nr_zones_) return;
+  zones_[zone].heat.store(0, std::memory_order_relaxed);
+  zones_[zone].heat_epoch.store(HeatEpoch(), std::memory_order_relaxed);
+}
+
+/* Upper bound of the bucket holding the pct percentile */
+uint64_t ZenFSZoneIO::Percentile(const OpStats &s, double pct) {
+  uint64_t count = s.count.load();
+  uint64_t want = (uint64_t)(count * pct / 100.0);
+  uint64_t seen = 0;
+  if (count == 0) return 0;
+  for (uint32_t b = 0; b < ZENFS_ZONE_LAT_BUCKETS; b++) {
+    seen += s.buckets[b].load();
+    if (seen > want) return (b == ZENFS_ZONE_LAT_BUCKETS - 1)
+                                ? s.max_micros.load()
+                                : (uint64_t{1} << b);
+  }
+  return s.max_micros.load();
+}
+
+void ZenFSZoneIO::ToString(std::string *out) {
+  char buf[192];
+  for (uint32_t z = 0; z < nr_zones_; z++) {
+    for (uint32_t op = 0; op < ZENFS_ZOP_NUM; op++) {
+      const OpStats &s = zones_[z].ops[op];
+      uint64_t count = s.count.load();
+      if (count == 0 && s.inflight.load() == 0) continue;
+      snprintf(buf, sizeof(buf),
+               "zone %5u %-8s count %10" PRIu64 " avg %8" PRIu64
+               " p50 %8" PRIu64 " p99 %8" PRIu64 " max %8" PRIu64
+               " inflight %u\n",
+               z, ZenFSZoneOpName(op), count,
+               count ? s.micros.load() / count : 0, Percentile(s, 50),
+               Percentile(s, 99), s.max_micros.load(), s.inflight.load());
+      out->append(buf);
+    }
+  }
+}
+
+void ZenFSZoneIO::ToMap(std::map<std::string, std::string> *out) {
+  for (uint32_t z = 0; z < nr_zones_; z++) {
+    for (uint32_t op = 0; op < ZENFS_ZOP_NUM; op++) {
+      const OpStats &s = zones_[z].ops[op];
+      uint64_t count = s.count.load();
+      if (count == 0 && s.inflight.load() == 0) continue;
+      std::string key =
+          std::to_string(z) + "." + ZenFSZoneOpName(op) + ".";
+      (*out)[key + "count"] = std::to_string(count);
+      (*out)[key + "avg"] =
+          std::to_string(count ? s.micros.load() / count : 0);
+      (*out)[key + "p50"] = std::to_string(Percentile(s, 50));
+      (*out)[key + "p99"] = std::to_string(Percentile(s, 99));
+      (*out)[key + "max"] = std::to_string(s.max_micros.load());
+      (*out)[key + "inflight"] = std::to_string(s.inflight.load());
+    }
+    uint64_t heat = Decay(&zones_[z]);
+    if (heat) (*out)[std::to_string(z) + ".read-heat"] = std::to_string(heat);
+  }
+}
+
+void ZenFSZoneIO::SummaryToString(std::string *out) {
+  char buf[192];
+  for (uint32_t op = 0; op < ZENFS_ZOP_NUM; op++) {
+    OpStats all;
+    Clear(&all);
+    for (uint32_t z = 0; z < nr_zones_; z++) {
+      const OpStats &s = zones_[z].ops[op];
+      for (uint32_t b = 0; b < ZENFS_ZONE_LAT_BUCKETS; b++)
+        all.buckets[b] += s.buckets[b].load();
+      all.count += s.count.load();
+      all.micros += s.micros.load();
+      if (s.max_micros.load() > all.max_micros.load())
+        all.max_micros.store(s.max_micros.load());
+    }
+    uint64_t count = all.count.load();
+    snprintf(buf, sizeof(buf),
+             "zone-io %-8s count %10" PRIu64 " avg %8" PRIu64 " p50 %8" PRIu64
+             " p99 %8" PRIu64 " max %8" PRIu64 " inflight %" PRIu64 "\n",
+             ZenFSZoneOpName(op), count,
+             count ? all.micros.load() / count : 0, Percentile(all, 50),
+             Percentile(all, 99), all.max_micros.load(),
+             inflight_[op].load());
+    out->append(buf);
+  }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
@@ -0,0 +1,140 @@
+// Copyright (c) Facebook, Inc. and its affiliates. All Rights Reserved.
+// Copyright (c) 2019-present, Western Digital Corporation
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#pragma once
+
+#if !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ROCKSDB_NAMESPACE {
+
+/* Zone operations timed by ZenFSZoneIO */
+enum ZenFSZoneOp : uint32_t {
+  ZENFS_ZOP_READ = 0, /* foreground reads */
+  ZENFS_ZOP_APPEND,   /* file and metadata appends */
+  ZENFS_ZOP_RESET,
+  ZENFS_ZOP_FINISH,
+  ZENFS_ZOP_GC_COPY, /* ZoneCleaning reads and relocation appends */
+  ZENFS_ZOP_NUM
+};
+
+const char *ZenFSZoneOpName(uint32_t op);
+
+/* Latency buckets are powers of two in micros, the last is open ended */
+#define ZENFS_ZONE_LAT_BUCKETS (24)
+
+/* Zone read heat halves every this many seconds */
+#define ZENFS_READ_HEAT_HALF_LIFE_S (30)
+
+/* Thread local ZenFS I/O time. Reset it before a DB call and read it
+ * after, next to RocksDB's PerfContext, to split the call into device time
+ * and in-memory work. */
+struct ZenFSPerfContext {
+  uint64_t read_nanos = 0;
+  uint64_t read_count = 0;
+  uint64_t read_bytes = 0;
+  uint64_t write_nanos = 0;
+  uint64_t write_count = 0;
+  uint64_t write_bytes = 0;
+
+  void Reset() { *this = ZenFSPerfContext(); }
+  std::string ToString() const;
+};
+
+ZenFSPerfContext *get_zenfs_perf_context();
+
+/* Per zone latency histograms and in-flight counts of zone operations.
+ *
+ * Zones are keyed by device position (offset / zone size), so reads that
+ * only know a device offset need no zone lookup. All counters are relaxed
+ * atomics, a timed operation costs two clock reads and a few adds.
+ */
+class ZenFSZoneIO {
+ public:
+  /* Times one operation from construction to destruction */
+  class Scope {
+   public:
+    Scope(ZenFSZoneIO *io, uint64_t dev_off, ZenFSZoneOp op, uint64_t bytes);
+    ~Scope();
+
+   private:
+    ZenFSZoneIO *io_;
+    uint32_t zone_;
+    ZenFSZoneOp op_;
+    uint64_t bytes_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  /* Marks the calling thread as ZoneCleaning, its reads and appends are
+   * then counted as ZENFS_ZOP_GC_COPY */
+  class GCScope {
+   public:
+    GCScope();
+    ~GCScope();
+
+   private:
+    bool prev_;
+  };
+
+  ZenFSZoneIO();
+
+  /* Sizes the tables once the device geometry is known */
+  void Init(uint32_t nr_zones, uint64_t zone_sz);
+
+  /* Operations of this kind in progress on the whole device */
+  uint64_t InFlight(ZenFSZoneOp op) { return inflight_[op].load(); }
+
+  /* Foreground reads of the zone at dev_off, decayed with a half life of
+   * ZENFS_READ_HEAT_HALF_LIFE_S */
+  uint64_t ReadHeat(uint64_t dev_off);
+  /* Forget the heat of the zone at dev_off, its data is gone after a reset */
+  void ClearReadHeat(uint64_t dev_off);
+
+  /* "zone op count avg p50 p99 max inflight" per zone and op with I/O */
+  void ToString(std::string *out);
+  /* The same as <zone>.<op>.<field> */
+  void ToMap(std::map<std::string, std::string> *out);
+  /* Device wide per op summary, for DumpStats */
+  void SummaryToString(std::string *out);
+
+ private:
+  struct OpStats {
+    std::atomic<uint64_t> buckets[ZENFS_ZONE_LAT_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> micros;
+    std::atomic<uint64_t> max_micros;
+    std::atomic<uint32_t> inflight;
+  };
+  struct ZoneStats {
+    OpStats ops[ZENFS_ZOP_NUM];
+    std::atomic<uint64_t> heat;
+    std::atomic<uint32_t> heat_epoch;
+  };
+
+  static void Clear(OpStats *s);
+  static uint64_t Percentile(const OpStats &s, double pct);
+  OpStats *Get(uint32_t zone, ZenFSZoneOp op);
+  void Begin(uint32_t zone, ZenFSZoneOp op);
+  void End(uint32_t zone, ZenFSZoneOp op, uint64_t micros);
+  /* Heat of the zone decayed to the current epoch */
+  uint64_t Decay(ZoneStats *zs);
+
+  std::unique_ptr<ZoneStats[]> zones_;
+  uint32_t nr_zones_;
+  uint64_t zone_sz_;
+  std::atomic<uint64_t> inflight_[ZENFS_ZOP_NUM];
+};
+
+}  // namespace ROCKSDB_NAMESPACE
+
+#endif  // !defined(ROCKSDB_LITE) && !defined(OS_WIN) && defined(LIBZBD)